@@ -0,0 +1,595 @@
+/**
+ * 命令模式（Command Pattern）的命令日志
+ *
+ * command.cpp 中 Broker::placeOrders 执行完订单就 m_orderList.clear()，进程崩溃后命令流就丢了。
+ *
+ * 这里增加一个只追加的二进制日志（Journal）：
+ *      1、每个 Order 编码成 8 字节的 JournalRecord（股票编号、操作、校验），JournalingBroker 先写日志，
+ *         确认落盘之后再执行订单（write-ahead）。
+ *      2、组提交（group commit）：多个线程同时提交时，第一个线程负责把所有已经追加的记录一次 write
+ *         并 fdatasync，其余线程等待这次同步完成；同步进行中到达的记录合并到下一次同步。
+ *         SyncMode::EachOrder 每次追加都立即写出并同步，仅用于对照。
+ *      3、重放时用 mmap 映射整个日志文件，顺序解码并在栈上构造订单执行，不做任何分配。
+ *         末尾不完整或校验失败的记录（写到一半时崩溃）被忽略，重新打开日志时截掉。
+ *      4、写出或同步失败（例如磁盘已满）之后日志进入失败状态，当前和之后的 append/sync 都抛出异常，
+ *         不会有线程一直等待。
+ *
+ * 运行 `command_journal bench [records] [path]` 在本地文件系统上对比两种同步方式，
+ * 并测量重放 records 条记录的速度。
+*/
+
+#include <iostream>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct JournalRecord {
+    enum Operation : uint16_t {
+        Buy = 1,
+        Sell = 2
+    };
+
+    uint32_t stock;
+    uint16_t operation;
+    uint16_t check;
+
+    static JournalRecord make(uint32_t stock, Operation operation) {
+        JournalRecord record = {stock, operation, checksum(stock, operation)};
+        return record;
+    }
+
+    bool isValid() const {
+        return (operation == Buy || operation == Sell) && check == checksum(stock, operation);
+    }
+
+    static uint16_t checksum(uint32_t stock, uint16_t operation) {
+        uint32_t h = (stock ^ (uint32_t(operation) << 16)) * 0x9e3779b1u;
+        return uint16_t((h >> 16) ^ h ^ 0x5a5a);
+    }
+};
+
+static const char JournalMagic[8] = {'C', 'M', 'D', 'J', 'R', 'N', 'L', '1'};
+
+static std::runtime_error systemError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+//只读映射整个日志文件
+class JournalReader {
+public:
+    JournalReader(const std::string& path) : m_data(nullptr), m_size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            throw systemError("open", path);
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw systemError("stat", path);
+        }
+
+        m_size = st.st_size;
+
+        if (m_size > 0) {
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw systemError("mmap", path);
+            }
+
+            m_data = static_cast<const char*>(data);
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+
+        ::close(fd);
+
+        if (m_size < sizeof(JournalMagic) || std::memcmp(m_data, JournalMagic, sizeof(JournalMagic)) != 0) {
+            unmap();
+            throw std::runtime_error("not a command journal: " + path);
+        }
+    }
+
+    ~JournalReader() {
+        unmap();
+    }
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    //依次把每条有效记录交给 visit，遇到第一条无效记录时停止，返回有效记录数
+    template<typename Visitor>
+    size_t replay(Visitor visit) const {
+        size_t count = (m_size - sizeof(JournalMagic)) / sizeof(JournalRecord);
+        const char* p = m_data + sizeof(JournalMagic);
+        size_t i = 0;
+
+        for (; i < count; ++i) {
+            JournalRecord record;
+            std::memcpy(&record, p + i * sizeof(JournalRecord), sizeof(JournalRecord));
+
+            if (!record.isValid()) {
+                break;
+            }
+
+            visit(record);
+        }
+
+        return i;
+    }
+
+    size_t getSize() const {
+        return m_size;
+    }
+
+private:
+    void unmap() {
+        if (m_data != nullptr) {
+            munmap(const_cast<char*>(m_data), m_size);
+            m_data = nullptr;
+        }
+    }
+
+    const char* m_data;
+    size_t m_size;
+};
+
+enum class SyncMode {
+    EachOrder,
+    GroupCommit
+};
+
+class Journal {
+public:
+    Journal(const std::string& path, SyncMode mode = SyncMode::GroupCommit) : m_path(path), m_mode(mode),
+        m_appended(0), m_durable(0), m_syncing(false), m_failed(false), m_syncs(0) {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+
+        if (m_fd < 0) {
+            throw systemError("open", path);
+        }
+
+        struct stat st;
+
+        if (fstat(m_fd, &st) != 0) {
+            ::close(m_fd);
+            throw systemError("stat", path);
+        }
+
+        off_t end = sizeof(JournalMagic);
+
+        //比文件头还短：写文件头时崩溃，当作空文件
+        if (st.st_size < end) {
+            if (ftruncate(m_fd, 0) != 0 || ::write(m_fd, JournalMagic, sizeof(JournalMagic)) !=
+                    (ssize_t)sizeof(JournalMagic) || fdatasync(m_fd) != 0) {
+                ::close(m_fd);
+                throw systemError("write", path);
+            }
+        } else {
+            //截掉崩溃时写了一半的记录，文件头或记录损坏时同样要关闭 m_fd
+            try {
+                JournalReader reader(path);
+                end += reader.replay([](const JournalRecord&) {}) * sizeof(JournalRecord);
+            } catch (...) {
+                ::close(m_fd);
+                throw;
+            }
+
+            if (end != st.st_size && ftruncate(m_fd, end) != 0) {
+                ::close(m_fd);
+                throw systemError("truncate", path);
+            }
+        }
+
+        if (lseek(m_fd, end, SEEK_SET) < 0) {
+            ::close(m_fd);
+            throw systemError("seek", path);
+        }
+    }
+
+    ~Journal() {
+        ::close(m_fd);
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    //追加到内存缓冲区，返回最后一条记录的序号，sync 之前不保证落盘
+    uint64_t append(const JournalRecord* records, size_t count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        checkFailed();
+        m_appended += count;
+
+        if (m_mode == SyncMode::EachOrder) {
+            try {
+                writeAll(records, count * sizeof(JournalRecord));
+                flush();
+            } catch (...) {
+                m_failed = true;
+                throw;
+            }
+
+            ++m_syncs;
+            m_durable = m_appended;
+            return m_appended;
+        }
+
+        m_buffer.insert(m_buffer.end(), records, records + count);
+        return m_appended;
+    }
+
+    //等待序号不超过 lsn 的记录全部落盘
+    void sync(uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (m_durable < lsn) {
+            checkFailed();
+
+            if (m_syncing) {
+                m_synced.wait(lock);
+                continue;
+            }
+
+            //成为本轮的提交者，把目前缓冲区中的所有记录一起写出
+            m_syncing = true;
+            std::vector<JournalRecord> pending;
+            pending.swap(m_buffer);
+            uint64_t target = m_appended;
+
+            lock.unlock();
+
+            try {
+                writeAll(pending.data(), pending.size() * sizeof(JournalRecord));
+                flush();
+            } catch (...) {
+                //文件末尾可能留下写了一半的记录，不能再追加；记录放回缓冲区，唤醒等待者让它们也失败
+                lock.lock();
+                m_buffer.insert(m_buffer.begin(), pending.begin(), pending.end());
+                m_failed = true;
+                m_syncing = false;
+                m_synced.notify_all();
+                throw;
+            }
+
+            lock.lock();
+
+            ++m_syncs;
+            m_durable = target;
+            m_syncing = false;
+            m_synced.notify_all();
+        }
+    }
+
+    size_t getSyncCount() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_syncs;
+    }
+
+private:
+    void checkFailed() const {
+        if (m_failed) {
+            throw std::runtime_error("journal failed after a write error: " + m_path);
+        }
+    }
+
+    void flush() {
+        if (fdatasync(m_fd) != 0) {
+            throw systemError("fdatasync", m_path);
+        }
+    }
+
+    void writeAll(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+
+        while (size > 0) {
+            ssize_t written = ::write(m_fd, p, size);
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw systemError("write", m_path);
+            }
+
+            p += written;
+            size -= written;
+        }
+    }
+
+    std::string m_path;
+    SyncMode m_mode;
+    int m_fd;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_synced;
+    std::vector<JournalRecord> m_buffer;
+    uint64_t m_appended;
+    uint64_t m_durable;
+    bool m_syncing;
+    //写出或同步失败之后，append 和 sync 都抛出异常
+    bool m_failed;
+    size_t m_syncs;
+};
+
+class Stock {
+public:
+    //log 为空时不输出，只记录持仓
+    Stock(uint32_t id, const std::string& name, std::ostream* log = nullptr) : m_id(id), m_name(name),
+        m_quantity(10), m_position(0), m_log(log) {}
+
+    uint32_t getId() const {
+        return m_id;
+    }
+
+    int64_t getPosition() const {
+        return m_position;
+    }
+
+    void buy() {
+        m_position += m_quantity;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] bought" << std::endl;
+        }
+    }
+
+    void sell() {
+        m_position -= m_quantity;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] sold" << std::endl;
+        }
+    }
+
+private:
+    uint32_t m_id;
+    std::string m_name;
+    int m_quantity;
+    int64_t m_position;
+    std::ostream* m_log;
+};
+
+class Order {
+public:
+    virtual void execute() = 0;
+    virtual JournalRecord encode() const = 0;
+    virtual ~Order() = default;
+};
+
+class BuyStock: public Order {
+public:
+    BuyStock(Stock& abcStock) : m_abcStock(abcStock) {}
+
+    virtual void execute() override {
+        m_abcStock.buy();
+    }
+
+    virtual JournalRecord encode() const override {
+        return JournalRecord::make(m_abcStock.getId(), JournalRecord::Buy);
+    }
+
+private:
+    Stock& m_abcStock;
+};
+
+class SellStock: public Order {
+public:
+    SellStock(Stock& abcStock) : m_abcStock(abcStock) {}
+
+    virtual void execute() override {
+        m_abcStock.sell();
+    }
+
+    virtual JournalRecord encode() const override {
+        return JournalRecord::make(m_abcStock.getId(), JournalRecord::Sell);
+    }
+
+private:
+    Stock& m_abcStock;
+};
+
+class JournalingBroker {
+public:
+    JournalingBroker(Journal& journal) : m_journal(journal) {}
+
+    void takeOrder(std::shared_ptr<Order> order) {
+        m_orderList.push_back(order);
+    }
+
+    //先把整批订单写入日志并等待落盘，再执行
+    void placeOrders() {
+        if (m_orderList.empty()) {
+            return;
+        }
+
+        m_records.clear();
+
+        for (auto& order : m_orderList) {
+            m_records.push_back(order->encode());
+        }
+
+        m_journal.sync(m_journal.append(m_records.data(), m_records.size()));
+
+        for (auto order : m_orderList) {
+            order->execute();
+        }
+
+        m_orderList.clear();
+    }
+
+private:
+    Journal& m_journal;
+    std::list<std::shared_ptr<Order>> m_orderList;
+    std::vector<JournalRecord> m_records;
+};
+
+//按日志重新执行订单，stocks[i] 的编号为 i，返回重放的记录数
+static size_t replay(const std::string& path, std::vector<Stock>& stocks) {
+    JournalReader reader(path);
+
+    return reader.replay([&stocks, &path](const JournalRecord& record) {
+        if (record.stock >= stocks.size() || (record.operation != JournalRecord::Buy &&
+                                              record.operation != JournalRecord::Sell)) {
+            throw std::runtime_error("corrupt journal: " + path);
+        }
+
+        Stock& stock = stocks[record.stock];
+
+        if (record.operation == JournalRecord::Buy) {
+            BuyStock(stock).execute();
+        } else {
+            SellStock(stock).execute();
+        }
+    });
+}
+
+static std::vector<Stock> makeStocks(size_t count, std::ostream* log = nullptr) {
+    std::vector<Stock> stocks;
+
+    for (size_t i = 0; i < count; ++i) {
+        stocks.push_back(Stock((uint32_t)i, "S" + std::to_string(i), log));
+    }
+
+    return stocks;
+}
+
+//threads 个线程各自用一个 JournalingBroker 逐单提交
+static void benchCommit(const std::string& path, SyncMode mode, size_t threads, size_t orders) {
+    unlink(path.c_str());
+    Journal journal(path, mode);
+    std::vector<Stock> stocks = makeStocks(threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&journal, &stocks, t, threads, orders]() {
+            JournalingBroker broker(journal);
+            std::shared_ptr<Order> buy = std::make_shared<BuyStock>(stocks[t]);
+
+            for (size_t i = t; i < orders; i += threads) {
+                broker.takeOrder(buy);
+                broker.placeOrders();
+            }
+        }));
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (mode == SyncMode::GroupCommit ? "group commit" : "each order") << ": " << orders << " orders, " <<
+              threads << " threads, " << journal.getSyncCount() << " fdatasync, " << orders / seconds <<
+              " orders/s" << std::endl;
+}
+
+static int bench(size_t records, const std::string& path) {
+    benchCommit(path, SyncMode::EachOrder, 8, 2000);
+    benchCommit(path, SyncMode::GroupCommit, 8, 2000);
+
+    //大批量写入后重放
+    unlink(path.c_str());
+    std::vector<Stock> live = makeStocks(1000);
+
+    {
+        Journal journal(path);
+        JournalingBroker broker(journal);
+        std::vector<std::shared_ptr<Order>> orders;
+
+        for (auto& stock : live) {
+            orders.push_back(std::make_shared<BuyStock>(stock));
+            orders.push_back(std::make_shared<SellStock>(stock));
+        }
+
+        for (size_t i = 0; i < records; ++i) {
+            broker.takeOrder(orders[(i * 7 + i / 3) % orders.size()]);
+
+            if (i % 4096 == 4095) {
+                broker.placeOrders();
+            }
+        }
+
+        broker.placeOrders();
+    }
+
+    std::vector<Stock> replayed = makeStocks(live.size());
+    auto start = std::chrono::steady_clock::now();
+    size_t count = replay(path, replayed);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb = count * sizeof(JournalRecord) / double(1 << 20);
+
+    std::cout << "replay: " << count << " records, " << mb << " MB, " << seconds * 1000 << " ms, " << mb / seconds <<
+              " MB/s" << std::endl;
+
+    bool ok = count == records;
+
+    for (size_t i = 0; i < live.size(); ++i) {
+        ok = ok && live[i].getPosition() == replayed[i].getPosition();
+    }
+
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 10000000, argc > 3 ? argv[3] : "command_journal.bench.log");
+    }
+
+    const std::string path = "command_journal.demo.log";
+    unlink(path.c_str());
+
+    std::vector<Stock> stocks = makeStocks(1, &std::cout);
+    Stock& abcStock = stocks[0];
+
+    {
+        Journal journal(path);
+        JournalingBroker broker(journal);
+
+        std::shared_ptr<BuyStock> buyStockOrder = std::make_shared<BuyStock>(abcStock);
+        std::shared_ptr<SellStock> sellStockOrder = std::make_shared<SellStock>(abcStock);
+
+        broker.takeOrder(buyStockOrder);
+        broker.takeOrder(sellStockOrder);
+        broker.placeOrders();
+    }
+
+    //模拟崩溃时写了一半的记录
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+
+        if (fd >= 0) {
+            JournalRecord torn = JournalRecord::make(0, JournalRecord::Buy);
+
+            if (::write(fd, &torn, sizeof(torn) / 2) < 0) {
+                std::cout << "write failed" << std::endl;
+            }
+
+            ::close(fd);
+        }
+    }
+
+    std::cout << "Replay after restart:" << std::endl;
+    std::vector<Stock> restarted = makeStocks(1, &std::cout);
+    std::cout << replay(path, restarted) << " orders replayed" << std::endl;
+
+    unlink(path.c_str());
+    return 0;
+}
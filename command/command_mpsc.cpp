@@ -0,0 +1,361 @@
+/**
+ * 命令模式（Command Pattern）的多生产者单消费者订单队列
+ *
+ * command.cpp 中的 Broker 用 std::list<std::shared_ptr<Order>> 保存订单，没有任何同步，
+ * 多个线程同时 takeOrder 会破坏链表；placeOrders 也是逐个取出执行。
+ *
+ * 这里的 ConcurrentBroker 用一个固定容量的环形缓冲区（OrderQueue）保存订单：
+ *      1、每个槽位有一个序号。生产者用 fetch_add 领取一个票号（ticket），不需要 CAS 重试，
+ *         票号对应的槽位空闲时直接写入并发布序号，因此队列不满时 takeOrder 是 wait-free 的。
+ *         队列满时生产者等待消费者腾出槽位，这就是背压。
+ *      2、消费者是唯一的，按票号顺序一次取出一批已经发布的订单，先释放槽位再执行这一批订单，
+ *         生产者可以尽早复用槽位，连续访问的槽位也便于预取。
+ * 每个槽位填充到一个缓存行的大小，减少相邻票号的生产者之间的伪共享。
+ *
+ * 运行 `command_mpsc bench [orders]` 输出 1 到 64 个生产者时的吞吐量和 takeOrder 的延迟分位数，
+ * 并与互斥锁保护的 std::list 做对比。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Order {
+public:
+    virtual void execute() = 0;
+    virtual ~Order() = default;
+};
+
+class Stock {
+public:
+    Stock() : m_name("ABC"), m_quantity(10) {}
+
+    void buy() {
+        std::cout << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] bought" << std::endl;
+    }
+
+    void sell() {
+        std::cout << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] sold" << std::endl;
+    }
+private:
+    std::string m_name;
+    int m_quantity;
+};
+
+class BuyStock: public Order {
+public:
+    BuyStock(Stock& abcStock) : m_abcStock(abcStock) {}
+
+    virtual void execute() override {
+        m_abcStock.buy();
+    }
+
+private:
+    Stock& m_abcStock;
+};
+
+class SellStock: public Order {
+public:
+    SellStock(Stock& abcStock) : m_abcStock(abcStock) {}
+
+    virtual void execute() override {
+        m_abcStock.sell();
+    }
+
+private:
+    Stock& m_abcStock;
+};
+
+class OrderQueue {
+public:
+    //capacity 向上取整为 2 的幂
+    OrderQueue(size_t capacity) : m_tail(0), m_head(0) {
+        m_capacity = 1;
+
+        while (m_capacity < capacity) {
+            m_capacity <<= 1;
+        }
+
+        m_mask = m_capacity - 1;
+        m_slots.reset(new Slot[m_capacity]);
+
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    OrderQueue(const OrderQueue&) = delete;
+    OrderQueue& operator=(const OrderQueue&) = delete;
+
+    //可以在任意线程中调用
+    void push(std::shared_ptr<Order> order) {
+        uint64_t ticket = m_tail.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = m_slots[ticket & m_mask];
+
+        //槽位的序号等于票号时表示消费者已经取走上一轮的订单
+        while (slot.sequence.load(std::memory_order_acquire) != ticket) {
+            std::this_thread::yield();
+        }
+
+        slot.order = std::move(order);
+        slot.sequence.store(ticket + 1, std::memory_order_release);
+    }
+
+    //已经分配出去的票号数，其中的订单可能还没有写好
+    uint64_t getTail() const {
+        return m_tail.load(std::memory_order_relaxed);
+    }
+
+    //只能在消费者线程中调用，最多取出 max 个票号小于 end 的订单追加到 batch，返回取出的个数
+    size_t drain(std::vector<std::shared_ptr<Order>>& batch, size_t max, uint64_t end) {
+        size_t n = 0;
+
+        while (n < max && m_head < end) {
+            Slot& slot = m_slots[m_head & m_mask];
+
+            //下一个票号还没有发布，后面的订单即使已经写好也要等它，保证按票号顺序执行
+            if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+                break;
+            }
+
+            __builtin_prefetch(&m_slots[(m_head + 1) & m_mask]);
+            batch.push_back(std::move(slot.order));
+            slot.sequence.store(m_head + m_capacity, std::memory_order_release);
+            ++m_head;
+            ++n;
+        }
+
+        return n;
+    }
+
+private:
+    //填充到一个缓存行的大小（C++11 的 new 不保证超过 16 字节的对齐）
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        std::shared_ptr<Order> order;
+        char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::shared_ptr<Order>)];
+    };
+
+    size_t m_capacity;
+    size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<uint64_t> m_tail;
+    alignas(64) uint64_t m_head;
+};
+
+class ConcurrentBroker {
+public:
+    ConcurrentBroker(size_t capacity = 4096, size_t batchSize = 256) : m_queue(capacity), m_batchSize(batchSize) {
+        m_batch.reserve(batchSize);
+    }
+
+    //可以在任意线程中调用
+    void takeOrder(std::shared_ptr<Order> order) {
+        m_queue.push(std::move(order));
+    }
+
+    //只能在一个线程中调用，执行当前已经提交的订单，返回执行的个数
+    //之后提交的订单留给下一次调用，生产者持续提交时也不会一直停在这里
+    size_t placeOrders() {
+        uint64_t end = m_queue.getTail();
+        size_t total = 0;
+
+        while (m_queue.drain(m_batch, m_batchSize, end) > 0) {
+            for (auto& order : m_batch) {
+                order->execute();
+            }
+
+            total += m_batch.size();
+            m_batch.clear();
+        }
+
+        return total;
+    }
+
+private:
+    OrderQueue m_queue;
+    size_t m_batchSize;
+    std::vector<std::shared_ptr<Order>> m_batch;
+};
+
+//command.cpp 的 Broker 加上互斥锁，只用于对照
+class LockedBroker {
+public:
+    void takeOrder(std::shared_ptr<Order> order) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_orderList.push_back(order);
+    }
+
+    size_t placeOrders() {
+        std::list<std::shared_ptr<Order>> orders;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            orders.swap(m_orderList);
+        }
+
+        for (auto order : orders) {
+            order->execute();
+        }
+
+        return orders.size();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::list<std::shared_ptr<Order>> m_orderList;
+};
+
+//只在消费者线程中执行
+class CountingOrder: public Order {
+public:
+    CountingOrder() : m_count(0) {}
+
+    virtual void execute() override {
+        ++m_count;
+    }
+
+    size_t getCount() const {
+        return m_count;
+    }
+
+private:
+    size_t m_count;
+};
+
+template<typename BrokerType>
+static bool benchBroker(const char* name, BrokerType& broker, size_t producers, size_t orders) {
+    //每个生产者提交自己的订单对象，避免所有线程争用同一个引用计数
+    std::vector<std::shared_ptr<CountingOrder>> producerOrders;
+
+    for (size_t p = 0; p < producers; ++p) {
+        producerOrders.push_back(std::make_shared<CountingOrder>());
+    }
+
+    //每个生产者至少提交一次，保证有延迟样本
+    size_t perProducer = std::max<size_t>(orders / producers, 1);
+    std::atomic<bool> go(false);
+    std::atomic<size_t> finished(0);
+    std::vector<std::vector<uint32_t>> samples(producers);
+    std::vector<std::thread> threads;
+
+    for (size_t p = 0; p < producers; ++p) {
+        threads.push_back(std::thread([&, p]() {
+            std::shared_ptr<Order> order = producerOrders[p];
+            std::vector<uint32_t>& latencies = samples[p];
+            latencies.reserve(perProducer / 8 + 1);
+
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+
+            for (size_t i = 0; i < perProducer; ++i) {
+                //每 8 次采样一次 takeOrder 的耗时
+                if (i % 8 == 0) {
+                    auto start = std::chrono::steady_clock::now();
+                    broker.takeOrder(order);
+                    latencies.push_back((uint32_t)std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>
+                                        (std::chrono::steady_clock::now() - start).count(), UINT32_MAX));
+                } else {
+                    broker.takeOrder(order);
+                }
+            }
+
+            ++finished;
+        }));
+    }
+
+    size_t executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+
+    while (finished.load() < producers) {
+        size_t n = broker.placeOrders();
+        executed += n;
+
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    executed += broker.placeOrders();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<uint32_t> latencies;
+
+    for (auto& sample : samples) {
+        latencies.insert(latencies.end(), sample.begin(), sample.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * p))];
+    };
+
+    std::cout << name << "\t" << producers << "\t" << executed / seconds / 1e6 << "\t" << percentile(0.5) << "\t" <<
+              percentile(0.99) << "\t" << percentile(0.999) << "\t" << latencies.back() << std::endl;
+
+    size_t counted = 0;
+
+    for (auto& order : producerOrders) {
+        counted += order->getCount();
+    }
+
+    return executed == perProducer * producers && counted == executed;
+}
+
+static int bench(size_t orders) {
+    std::cout << "orders: " << orders << " (takeOrder latency in ns)" << std::endl;
+    std::cout << "broker\tproducers\tMops/s\tp50\tp99\tp99.9\tmax" << std::endl;
+    bool ok = true;
+
+    for (size_t producers = 1; producers <= 64; producers *= 2) {
+        ConcurrentBroker concurrentBroker;
+        LockedBroker lockedBroker;
+        ok = benchBroker("ring", concurrentBroker, producers, orders) && ok;
+        ok = benchBroker("locked", lockedBroker, producers, orders) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 2000000);
+    }
+
+    Stock abcStock = Stock();
+
+    std::shared_ptr<BuyStock> buyStockOrder = std::make_shared<BuyStock>(abcStock);
+    std::shared_ptr<SellStock> sellStockOrder = std::make_shared<SellStock>(abcStock);
+
+    ConcurrentBroker broker;
+
+    //两个线程同时下单
+    std::thread buyer([&broker, buyStockOrder]() {
+        broker.takeOrder(buyStockOrder);
+    });
+    std::thread seller([&broker, sellStockOrder]() {
+        broker.takeOrder(sellStockOrder);
+    });
+
+    buyer.join();
+    seller.join();
+
+    std::cout << broker.placeOrders() << " orders placed" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+/**
+ * 命令模式（Command Pattern）的订单轧差
+ *
+ * command.cpp 中同一个 Stock 上先 BuyStock 再 SellStock，两个订单都会执行，各自产生副作用。
+ * 实际业务里排队的订单有很大一部分是相互抵消的。
+ *
+ * 这里的 Broker 在 placeOrders 执行一批订单之前先做一次优化：
+ *      1、可以轧差的订单（BuyStock/SellStock）通过 getNetting 报告自己的股票和带符号的手数。
+ *      2、按股票累加手数，买卖相互抵消，同方向的订单合并，每只股票最多生成一个净额订单，
+ *         净额为 0 的股票不执行任何订单。股票按第一次出现的顺序输出。
+ *      3、不能轧差的订单是屏障：遇到它时先输出之前累积的净额订单，再执行它，不会跨越它重排。
+ * NettingReport 记录提交、实际执行、省掉的执行次数，以及完全抵消的股票数。
+ *
+ * 运行 `command_netting bench [orders]` 对比逐个执行与轧差后执行的耗时（执行订单时格式化一行成交记录）。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Stock {
+public:
+    //log 为空时不输出，只记录持仓
+    Stock(const std::string& name = "ABC", std::ostream* log = &std::cout) : m_name(name), m_quantity(10),
+        m_position(0), m_log(log) {}
+
+    int64_t getPosition() const {
+        return m_position;
+    }
+
+    void buy(int lots = 1) {
+        //轧差后的订单最多有 INT32_MAX 手，按 64 位计算数量
+        int64_t quantity = (int64_t)m_quantity * lots;
+        m_position += quantity;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << quantity << " ] bought" << std::endl;
+        }
+    }
+
+    void sell(int lots = 1) {
+        int64_t quantity = (int64_t)m_quantity * lots;
+        m_position -= quantity;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << quantity << " ] sold" << std::endl;
+        }
+    }
+
+private:
+    std::string m_name;
+    int m_quantity;
+    int64_t m_position;
+    std::ostream* m_log;
+};
+
+class Order {
+public:
+    virtual void execute() = 0;
+    virtual ~Order() = default;
+
+    //可以轧差时返回 true，lots 为带符号的手数（买为正、卖为负）
+    virtual bool getNetting(Stock*& stock, int64_t& lots) const {
+        (void)stock;
+        (void)lots;
+        return false;
+    }
+};
+
+class BuyStock: public Order {
+public:
+    BuyStock(Stock& abcStock, int lots = 1) : m_abcStock(abcStock), m_lots(lots) {}
+
+    virtual void execute() override {
+        m_abcStock.buy(m_lots);
+    }
+
+    virtual bool getNetting(Stock*& stock, int64_t& lots) const override {
+        stock = &m_abcStock;
+        lots = m_lots;
+        return true;
+    }
+
+private:
+    Stock& m_abcStock;
+    int m_lots;
+};
+
+class SellStock: public Order {
+public:
+    SellStock(Stock& abcStock, int lots = 1) : m_abcStock(abcStock), m_lots(lots) {}
+
+    virtual void execute() override {
+        m_abcStock.sell(m_lots);
+    }
+
+    virtual bool getNetting(Stock*& stock, int64_t& lots) const override {
+        stock = &m_abcStock;
+        lots = -m_lots;
+        return true;
+    }
+
+private:
+    Stock& m_abcStock;
+    int m_lots;
+};
+
+//不能轧差的订单，只用于演示屏障
+class PrintOrder: public Order {
+public:
+    PrintOrder(const std::string& message) : m_message(message) {}
+
+    virtual void execute() override {
+        std::cout << m_message << std::endl;
+    }
+
+private:
+    std::string m_message;
+};
+
+struct NettingReport {
+    NettingReport() : submitted(0), executed(0), flattened(0) {}
+
+    size_t getAvoided() const {
+        return submitted - executed;
+    }
+
+    size_t submitted;
+    size_t executed;
+    //买卖完全抵消、没有执行任何订单的股票（每遇到一个屏障分别统计）
+    size_t flattened;
+};
+
+class OrderNetting {
+public:
+    //把 orders 轧差后的订单追加到 netted
+    void optimize(const std::list<std::shared_ptr<Order>>& orders, std::vector<std::shared_ptr<Order>>& netted,
+                  NettingReport& report) {
+        for (auto& order : orders) {
+            Stock* stock;
+            int64_t lots;
+            ++report.submitted;
+
+            if (!order->getNetting(stock, lots)) {
+                flush(netted, report);
+                netted.push_back(order);
+                continue;
+            }
+
+            auto it = m_positions.find(stock);
+
+            if (it == m_positions.end()) {
+                m_positions[stock] = m_pending.size();
+                Pending pending = {stock, lots};
+                m_pending.push_back(pending);
+            } else {
+                m_pending[it->second].lots += lots;
+            }
+        }
+
+        flush(netted, report);
+        report.executed += netted.size();
+    }
+
+private:
+    struct Pending {
+        Stock* stock;
+        int64_t lots;
+    };
+
+    void flush(std::vector<std::shared_ptr<Order>>& netted, NettingReport& report) {
+        for (auto& pending : m_pending) {
+            //单个订单的手数是 int，超过时拆成多个订单
+            int64_t lots = pending.lots;
+
+            if (lots == 0) {
+                ++report.flattened;
+            }
+
+            while (lots != 0) {
+                int64_t chunk = std::min<int64_t>(std::llabs(lots), INT32_MAX);
+
+                if (lots > 0) {
+                    netted.push_back(std::make_shared<BuyStock>(*pending.stock, (int)chunk));
+                    lots -= chunk;
+                } else {
+                    netted.push_back(std::make_shared<SellStock>(*pending.stock, (int)chunk));
+                    lots += chunk;
+                }
+            }
+        }
+
+        m_pending.clear();
+        m_positions.clear();
+    }
+
+    std::vector<Pending> m_pending;
+    std::unordered_map<Stock*, size_t> m_positions;
+};
+
+class Broker {
+public:
+    Broker(bool netting = true) : m_netting(netting) {}
+
+    void takeOrder(std::shared_ptr<Order> order) {
+        m_orderList.push_back(order);
+    }
+
+    void placeOrders() {
+        if (!m_netting) {
+            for (auto order : m_orderList) {
+                order->execute();
+            }
+
+            m_report.submitted += m_orderList.size();
+            m_report.executed += m_orderList.size();
+            m_orderList.clear();
+            return;
+        }
+
+        m_netted.clear();
+        m_optimizer.optimize(m_orderList, m_netted, m_report);
+
+        for (auto& order : m_netted) {
+            order->execute();
+        }
+
+        m_netted.clear();
+        m_orderList.clear();
+    }
+
+    const NettingReport& getReport() const {
+        return m_report;
+    }
+
+private:
+    bool m_netting;
+    std::list<std::shared_ptr<Order>> m_orderList;
+    std::vector<std::shared_ptr<Order>> m_netted;
+    OrderNetting m_optimizer;
+    NettingReport m_report;
+};
+
+static void printReport(const NettingReport& report) {
+    std::cout << "submitted: " << report.submitted << ", executed: " << report.executed << ", avoided: " <<
+              report.getAvoided() << ", flattened stocks: " << report.flattened << std::endl;
+}
+
+static int bench(size_t orders) {
+    const size_t stockCount = 100;
+    //执行订单的副作用：格式化一行成交记录
+    std::ostringstream directLog;
+    std::ostringstream nettedLog;
+    std::vector<Stock> directStocks;
+    std::vector<Stock> nettedStocks;
+
+    for (size_t i = 0; i < stockCount; ++i) {
+        directStocks.push_back(Stock("S" + std::to_string(i), &directLog));
+        nettedStocks.push_back(Stock("S" + std::to_string(i), &nettedLog));
+    }
+
+    //每只股票的买单和卖单对象各一个，两个 Broker 提交相同的序列
+    std::vector<std::shared_ptr<Order>> directOrders;
+    std::vector<std::shared_ptr<Order>> nettedOrders;
+
+    for (size_t i = 0; i < stockCount; ++i) {
+        directOrders.push_back(std::make_shared<BuyStock>(directStocks[i]));
+        directOrders.push_back(std::make_shared<SellStock>(directStocks[i]));
+        nettedOrders.push_back(std::make_shared<BuyStock>(nettedStocks[i]));
+        nettedOrders.push_back(std::make_shared<SellStock>(nettedStocks[i]));
+    }
+
+    //买卖大致相当，大部分订单相互抵消
+    std::default_random_engine engine;
+    std::uniform_int_distribution<size_t> pick(0, directOrders.size() - 1);
+    std::vector<size_t> sequence;
+
+    for (size_t i = 0; i < orders; ++i) {
+        sequence.push_back(pick(engine));
+    }
+
+    Broker direct(false);
+    Broker netted;
+    double directMs = 0;
+    double nettedMs = 0;
+
+    for (size_t begin = 0; begin < orders; begin += 10000) {
+        size_t end = std::min(begin + 10000, orders);
+
+        for (size_t i = begin; i < end; ++i) {
+            direct.takeOrder(directOrders[sequence[i]]);
+            netted.takeOrder(nettedOrders[sequence[i]]);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        direct.placeOrders();
+        auto middle = std::chrono::steady_clock::now();
+        netted.placeOrders();
+        auto stop = std::chrono::steady_clock::now();
+
+        directLog.str("");
+        nettedLog.str("");
+        directMs += std::chrono::duration<double, std::milli>(middle - start).count();
+        nettedMs += std::chrono::duration<double, std::milli>(stop - middle).count();
+    }
+
+    std::cout << "orders: " << orders << ", stocks: " << stockCount << ", batch: 10000" << std::endl;
+    std::cout << "direct: " << directMs << " ms" << std::endl;
+    std::cout << "netted: " << nettedMs << " ms (including the netting pass)" << std::endl;
+    printReport(netted.getReport());
+
+    for (size_t i = 0; i < stockCount; ++i) {
+        if (directStocks[i].getPosition() != nettedStocks[i].getPosition()) {
+            std::cout << "position mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000000);
+    }
+
+    Stock abcStock = Stock();
+    Stock xyzStock = Stock("XYZ");
+
+    std::shared_ptr<BuyStock> buyStockOrder = std::make_shared<BuyStock>(abcStock);
+    std::shared_ptr<SellStock> sellStockOrder = std::make_shared<SellStock>(abcStock);
+    std::shared_ptr<BuyStock> buyXyzOrder = std::make_shared<BuyStock>(xyzStock);
+
+    Broker broker = Broker();
+    broker.takeOrder(buyStockOrder);
+    broker.takeOrder(buyXyzOrder);
+    broker.takeOrder(sellStockOrder);
+    broker.takeOrder(buyXyzOrder);
+    broker.takeOrder(std::make_shared<PrintOrder>("--- end of day ---"));
+    broker.takeOrder(buyStockOrder);
+    broker.takeOrder(buyStockOrder);
+
+    broker.placeOrders();
+    printReport(broker.getReport());
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+/**
+ * 命令模式（Command Pattern）的小对象内联存储
+ *
+ * command.cpp 中每个 BuyStock/SellStock 都是一次 make_shared 堆分配，加入 std::list 又是一次分配，
+ * 而命令本身只保存了一个 Stock&，执行时还要经过 shared_ptr 做一次虚函数调用。
+ *
+ * 这里的 Command 是一个类型擦除、只能移动的命令对象：
+ *      1、任何带有 execute() 成员函数的类型都可以放进 Command，不需要继承 Order。
+ *      2、不超过 3 个指针大小、并且可以无异常移动的命令直接存放在 Command 内部的缓冲区中（小对象优化），
+ *         更大的命令才退回到堆上。
+ *      3、每种命令类型对应一张静态的函数表（执行、移动、析构），Command 只保存一个指向它的指针。
+ * CommandBuffer 把 Command 连续存放在一个 std::vector 中，清空时保留容量，
+ * 预留空间之后排队和执行上百万个订单都不需要分配内存。
+ *
+ * 运行 `command_sbo bench [orders]` 与 std::list<std::shared_ptr<Order>> 对比耗时和堆分配次数。
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//统计堆分配次数，只用于 bench
+static size_t s_allocations = 0;
+
+void* operator new(size_t size) {
+    ++s_allocations;
+    void* p = std::malloc(size != 0 ? size : 1);
+
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+class Command {
+public:
+    //内联存储的大小
+    static const size_t Capacity = 3 * sizeof(void*);
+
+    Command() : m_operations(nullptr) {}
+
+    template<typename T, typename = typename std::enable_if<!std::is_same<typename std::decay<T>::type, Command>::value>::type>
+    Command(T&& order) : m_operations(nullptr) {
+        typedef typename std::decay<T>::type Type;
+        construct<Type>(std::forward<T>(order), std::integral_constant<bool, fitsInline<Type>()>());
+    }
+
+    Command(Command&& other) noexcept : m_operations(other.m_operations) {
+        if (m_operations != nullptr) {
+            m_operations->move(&other.m_storage, &m_storage);
+            other.m_operations = nullptr;
+        }
+    }
+
+    Command& operator=(Command&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_operations = other.m_operations;
+
+            if (m_operations != nullptr) {
+                m_operations->move(&other.m_storage, &m_storage);
+                other.m_operations = nullptr;
+            }
+        }
+
+        return *this;
+    }
+
+    Command(const Command&) = delete;
+    Command& operator=(const Command&) = delete;
+
+    ~Command() {
+        reset();
+    }
+
+    void execute() {
+        m_operations->execute(&m_storage);
+    }
+
+    explicit operator bool() const {
+        return m_operations != nullptr;
+    }
+
+private:
+    struct Operations {
+        void (*execute)(void* storage);
+        //把 from 中的命令移动到 to，并析构 from 中的命令
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+    };
+
+    typedef typename std::aligned_storage<Capacity, alignof(void*)>::type Storage;
+
+    template<typename T>
+    static constexpr bool fitsInline() {
+        return sizeof(T) <= sizeof(Storage) && alignof(Storage) % alignof(T) == 0 &&
+               std::is_nothrow_move_constructible<T>::value;
+    }
+
+    template<typename T>
+    struct Inline {
+        static void execute(void* storage) {
+            static_cast<T*>(storage)->execute();
+        }
+
+        static void move(void* from, void* to) {
+            new (to) T(std::move(*static_cast<T*>(from)));
+            static_cast<T*>(from)->~T();
+        }
+
+        static void destroy(void* storage) {
+            static_cast<T*>(storage)->~T();
+        }
+
+        static const Operations operations;
+    };
+
+    template<typename T>
+    struct Heap {
+        static void execute(void* storage) {
+            (*static_cast<T**>(storage))->execute();
+        }
+
+        static void move(void* from, void* to) {
+            *static_cast<T**>(to) = *static_cast<T**>(from);
+        }
+
+        static void destroy(void* storage) {
+            delete *static_cast<T**>(storage);
+        }
+
+        static const Operations operations;
+    };
+
+    template<typename T, typename U>
+    void construct(U&& order, std::true_type) {
+        new (&m_storage) T(std::forward<U>(order));
+        m_operations = &Inline<T>::operations;
+    }
+
+    template<typename T, typename U>
+    void construct(U&& order, std::false_type) {
+        *reinterpret_cast<T**>(&m_storage) = new T(std::forward<U>(order));
+        m_operations = &Heap<T>::operations;
+    }
+
+    void reset() {
+        if (m_operations != nullptr) {
+            m_operations->destroy(&m_storage);
+            m_operations = nullptr;
+        }
+    }
+
+    Storage m_storage;
+    const Operations* m_operations;
+};
+
+template<typename T>
+const Command::Operations Command::Inline<T>::operations = {&Inline<T>::execute, &Inline<T>::move, &Inline<T>::destroy};
+
+template<typename T>
+const Command::Operations Command::Heap<T>::operations = {&Heap<T>::execute, &Heap<T>::move, &Heap<T>::destroy};
+
+//连续存放的命令队列，clear 之后容量保留
+class CommandBuffer {
+public:
+    void reserve(size_t count) {
+        m_commands.reserve(count);
+    }
+
+    void push(Command command) {
+        m_commands.push_back(std::move(command));
+    }
+
+    template<typename T, typename... Args>
+    void emplace(Args&&... args) {
+        m_commands.push_back(Command(T(std::forward<Args>(args)...)));
+    }
+
+    void executeAll() {
+        for (auto& command : m_commands) {
+            command.execute();
+        }
+    }
+
+    void clear() {
+        m_commands.clear();
+    }
+
+    size_t size() const {
+        return m_commands.size();
+    }
+
+private:
+    std::vector<Command> m_commands;
+};
+
+class Stock {
+public:
+    Stock() : m_name("ABC"), m_quantity(10) {}
+
+    void buy() {
+        std::cout << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] bought" << std::endl;
+    }
+
+    void sell() {
+        std::cout << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity << " ] sold" << std::endl;
+    }
+private:
+    std::string m_name;
+    int m_quantity;
+};
+
+//不需要继承，也不需要虚函数
+class BuyStock {
+public:
+    BuyStock(Stock& abcStock) : m_abcStock(&abcStock) {}
+
+    void execute() {
+        m_abcStock->buy();
+    }
+
+private:
+    Stock* m_abcStock;
+};
+
+class SellStock {
+public:
+    SellStock(Stock& abcStock) : m_abcStock(&abcStock) {}
+
+    void execute() {
+        m_abcStock->sell();
+    }
+
+private:
+    Stock* m_abcStock;
+};
+
+class Broker {
+public:
+    void reserve(size_t count) {
+        m_orderList.reserve(count);
+    }
+
+    void takeOrder(Command order) {
+        m_orderList.push(std::move(order));
+    }
+
+    void placeOrders() {
+        m_orderList.executeAll();
+        m_orderList.clear();
+    }
+
+private:
+    CommandBuffer m_orderList;
+};
+
+//以下只用于 bench：不输出的股票以及 command.cpp 风格的订单
+class Ledger {
+public:
+    Ledger() : m_bought(0), m_sold(0) {}
+
+    void buy() {
+        ++m_bought;
+    }
+
+    void sell() {
+        ++m_sold;
+    }
+
+    size_t getBought() const {
+        return m_bought;
+    }
+
+    size_t getSold() const {
+        return m_sold;
+    }
+
+private:
+    size_t m_bought;
+    size_t m_sold;
+};
+
+class Order {
+public:
+    virtual void execute() = 0;
+    virtual ~Order() = default;
+};
+
+class LegacyBuy: public Order {
+public:
+    LegacyBuy(Ledger& ledger) : m_ledger(ledger) {}
+
+    virtual void execute() override {
+        m_ledger.buy();
+    }
+
+private:
+    Ledger& m_ledger;
+};
+
+class LegacySell: public Order {
+public:
+    LegacySell(Ledger& ledger) : m_ledger(ledger) {}
+
+    virtual void execute() override {
+        m_ledger.sell();
+    }
+
+private:
+    Ledger& m_ledger;
+};
+
+class LedgerBuy {
+public:
+    LedgerBuy(Ledger& ledger) : m_ledger(&ledger) {}
+
+    void execute() {
+        m_ledger->buy();
+    }
+
+private:
+    Ledger* m_ledger;
+};
+
+class LedgerSell {
+public:
+    LedgerSell(Ledger& ledger) : m_ledger(&ledger) {}
+
+    void execute() {
+        m_ledger->sell();
+    }
+
+private:
+    Ledger* m_ledger;
+};
+
+static int bench(size_t orders) {
+    Ledger legacyLedger;
+    std::list<std::shared_ptr<Order>> orderList;
+
+    size_t allocations = s_allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < orders; ++i) {
+        if (i % 2 == 0) {
+            orderList.push_back(std::make_shared<LegacyBuy>(legacyLedger));
+        } else {
+            orderList.push_back(std::make_shared<LegacySell>(legacyLedger));
+        }
+    }
+
+    for (auto& order : orderList) {
+        order->execute();
+    }
+
+    orderList.clear();
+    double legacyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t legacyAllocations = s_allocations - allocations;
+
+    Ledger ledger;
+    CommandBuffer buffer;
+    buffer.reserve(orders);
+
+    //第二轮复用第一轮的容量
+    for (int round = 0; round < 2; ++round) {
+        allocations = s_allocations;
+        start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < orders; ++i) {
+            if (i % 2 == 0) {
+                buffer.emplace<LedgerBuy>(ledger);
+            } else {
+                buffer.emplace<LedgerSell>(ledger);
+            }
+        }
+
+        buffer.executeAll();
+        buffer.clear();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "CommandBuffer round " << round + 1 << ": " << ms << " ms, " << s_allocations - allocations <<
+                  " allocations" << std::endl;
+    }
+
+    std::cout << "std::list<std::shared_ptr<Order>>: " << legacyMs << " ms, " << legacyAllocations <<
+              " allocations" << std::endl;
+    std::cout << "sizeof(Command): " << sizeof(Command) << " bytes" << std::endl;
+
+    bool ok = ledger.getBought() == 2 * legacyLedger.getBought() && ledger.getSold() == 2 * legacyLedger.getSold();
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 10000000);
+    }
+
+    Stock abcStock = Stock();
+
+    Broker broker = Broker();
+    broker.reserve(16);
+    broker.takeOrder(BuyStock(abcStock));
+    broker.takeOrder(SellStock(abcStock));
+
+    size_t allocations = s_allocations;
+    broker.placeOrders();
+    broker.takeOrder(SellStock(abcStock));
+    broker.placeOrders();
+
+    std::cout << "allocations while queuing and placing orders: " << s_allocations - allocations << std::endl;
+
+    return 0;
+}
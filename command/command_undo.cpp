@@ -0,0 +1,364 @@
+/**
+ * 命令模式（Command Pattern）的撤销与重做
+ *
+ * command.cpp 中的 Order 执行之后就无法撤销。如果在每个命令执行前给 Stock 拍一份快照，
+ * 内存会翻倍。
+ *
+ * 这里让 Order 可以选择提供逆操作：getDelta 把自己描述成一个 8 字节的 Delta（股票编号、带符号的手数），
+ * 买的逆操作就是卖同样的手数。History 是一个容量固定的环形缓冲区，只保存 Delta，不复制任何对象：
+ *      1、执行：在当前位置写入 Delta，丢弃可以重做的部分；超过容量时覆盖最旧的一步。
+ *      2、撤销：位置后退一步，执行这一步的逆操作。
+ *      3、重做：重新执行当前位置的 Delta，位置前进一步。
+ * 每一步都是 O(1)，占用的内存是 容量 * sizeof(Delta)，与执行过的步数无关。
+ * 不提供逆操作的订单执行后清空历史，撤销不能越过它。
+ *
+ * 运行 `command_undo bench [steps] [capacity]` 执行、全部撤销、全部重做，并检查持仓。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+class Stock {
+public:
+    //log 为空时不输出，只记录持仓
+    Stock(uint32_t id, const std::string& name, std::ostream* log = &std::cout) : m_id(id), m_name(name),
+        m_quantity(10), m_position(0), m_log(log) {}
+
+    uint32_t getId() const {
+        return m_id;
+    }
+
+    int64_t getPosition() const {
+        return m_position;
+    }
+
+    void buy(int lots = 1) {
+        m_position += (int64_t)m_quantity * lots;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity * lots << " ] bought" << std::endl;
+        }
+    }
+
+    void sell(int lots = 1) {
+        m_position -= (int64_t)m_quantity * lots;
+
+        if (m_log != nullptr) {
+            *m_log << "Stock [ Name: " << m_name << ", Quantity: " << m_quantity * lots << " ] sold" << std::endl;
+        }
+    }
+
+private:
+    uint32_t m_id;
+    std::string m_name;
+    int m_quantity;
+    int64_t m_position;
+    std::ostream* m_log;
+};
+
+//一步可逆操作：对编号为 stock 的股票买入 lots 手（负数为卖出）
+struct Delta {
+    uint32_t stock;
+    int32_t lots;
+};
+
+class Order {
+public:
+    virtual void execute() = 0;
+    virtual ~Order() = default;
+
+    //可以撤销时返回 true
+    virtual bool getDelta(Delta& delta) const {
+        (void)delta;
+        return false;
+    }
+};
+
+class BuyStock: public Order {
+public:
+    BuyStock(Stock& abcStock, int lots = 1) : m_abcStock(abcStock), m_lots(lots) {}
+
+    virtual void execute() override {
+        m_abcStock.buy(m_lots);
+    }
+
+    virtual bool getDelta(Delta& delta) const override {
+        delta.stock = m_abcStock.getId();
+        delta.lots = m_lots;
+        return true;
+    }
+
+private:
+    Stock& m_abcStock;
+    int m_lots;
+};
+
+class SellStock: public Order {
+public:
+    SellStock(Stock& abcStock, int lots = 1) : m_abcStock(abcStock), m_lots(lots) {}
+
+    virtual void execute() override {
+        m_abcStock.sell(m_lots);
+    }
+
+    virtual bool getDelta(Delta& delta) const override {
+        delta.stock = m_abcStock.getId();
+        delta.lots = -m_lots;
+        return true;
+    }
+
+private:
+    Stock& m_abcStock;
+    int m_lots;
+};
+
+//不能撤销的订单
+class PrintOrder: public Order {
+public:
+    PrintOrder(const std::string& message) : m_message(message) {}
+
+    virtual void execute() override {
+        std::cout << m_message << std::endl;
+    }
+
+private:
+    std::string m_message;
+};
+
+class History {
+public:
+    History(size_t capacity) : m_deltas(std::max<size_t>(capacity, 1)), m_begin(0), m_cursor(0), m_end(0) {}
+
+    void record(const Delta& delta) {
+        m_deltas[m_cursor % m_deltas.size()] = delta;
+        m_end = ++m_cursor;
+
+        if (m_end - m_begin > m_deltas.size()) {
+            ++m_begin;
+        }
+    }
+
+    void clear() {
+        m_begin = m_cursor = m_end = 0;
+    }
+
+    bool canUndo() const {
+        return m_cursor > m_begin;
+    }
+
+    bool canRedo() const {
+        return m_cursor < m_end;
+    }
+
+    //后退一步，返回这一步的 Delta
+    const Delta& undo() {
+        return m_deltas[--m_cursor % m_deltas.size()];
+    }
+
+    //前进一步，返回这一步的 Delta
+    const Delta& redo() {
+        return m_deltas[m_cursor++ % m_deltas.size()];
+    }
+
+    size_t getUndoCount() const {
+        return m_cursor - m_begin;
+    }
+
+    size_t getRedoCount() const {
+        return m_end - m_cursor;
+    }
+
+    size_t getBytes() const {
+        return m_deltas.capacity() * sizeof(Delta);
+    }
+
+private:
+    std::vector<Delta> m_deltas;
+    //单调递增的步数，下标为 步数 % 容量；[m_begin, m_cursor) 可以撤销，[m_cursor, m_end) 可以重做
+    uint64_t m_begin;
+    uint64_t m_cursor;
+    uint64_t m_end;
+};
+
+class Broker {
+public:
+    //stocks[i] 的编号必须为 i
+    Broker(std::vector<Stock>& stocks, size_t capacity = 1024) : m_stocks(stocks), m_history(capacity) {}
+
+    void takeOrder(std::shared_ptr<Order> order) {
+        m_orderList.push_back(order);
+    }
+
+    void placeOrders() {
+        for (auto order : m_orderList) {
+            order->execute();
+            Delta delta;
+
+            if (order->getDelta(delta)) {
+                m_history.record(delta);
+            } else {
+                m_history.clear();
+            }
+        }
+
+        m_orderList.clear();
+    }
+
+    //执行最近一步的逆操作
+    bool undo() {
+        if (!m_history.canUndo()) {
+            return false;
+        }
+
+        const Delta& delta = m_history.undo();
+        apply(delta.stock, -(int64_t)delta.lots);
+        return true;
+    }
+
+    bool redo() {
+        if (!m_history.canRedo()) {
+            return false;
+        }
+
+        const Delta& delta = m_history.redo();
+        apply(delta.stock, delta.lots);
+        return true;
+    }
+
+    const History& getHistory() const {
+        return m_history;
+    }
+
+private:
+    //在栈上构造对应的订单执行
+    void apply(uint32_t stock, int64_t lots) {
+        if (lots >= 0) {
+            BuyStock(m_stocks[stock], (int)lots).execute();
+        } else {
+            SellStock(m_stocks[stock], (int)(-lots)).execute();
+        }
+    }
+
+    std::vector<Stock>& m_stocks;
+    std::list<std::shared_ptr<Order>> m_orderList;
+    History m_history;
+};
+
+static std::vector<int64_t> positions(const std::vector<Stock>& stocks) {
+    std::vector<int64_t> result;
+
+    for (auto& stock : stocks) {
+        result.push_back(stock.getPosition());
+    }
+
+    return result;
+}
+
+static int bench(size_t steps, size_t capacity) {
+    const size_t stockCount = 1000;
+    std::vector<Stock> stocks;
+
+    for (size_t i = 0; i < stockCount; ++i) {
+        stocks.push_back(Stock((uint32_t)i, "S" + std::to_string(i), nullptr));
+    }
+
+    std::vector<std::shared_ptr<Order>> orders;
+
+    for (auto& stock : stocks) {
+        orders.push_back(std::make_shared<BuyStock>(stock, 3));
+        orders.push_back(std::make_shared<SellStock>(stock, 2));
+    }
+
+    Broker broker(stocks, capacity);
+    std::default_random_engine engine;
+    std::uniform_int_distribution<size_t> pick(0, orders.size() - 1);
+    //历史能撤销到的最早状态
+    size_t oldest = steps > capacity ? steps - capacity : 0;
+    std::vector<int64_t> oldestPositions = positions(stocks);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < steps; ++i) {
+        if (i == oldest) {
+            oldestPositions = positions(stocks);
+        }
+
+        broker.takeOrder(orders[pick(engine)]);
+        broker.placeOrders();
+    }
+
+    auto executed = std::chrono::steady_clock::now();
+    std::vector<int64_t> finalPositions = positions(stocks);
+    size_t undone = 0;
+
+    while (broker.undo()) {
+        ++undone;
+    }
+
+    auto undoEnd = std::chrono::steady_clock::now();
+    bool ok = undone == steps - oldest && positions(stocks) == oldestPositions;
+    size_t redone = 0;
+
+    while (broker.redo()) {
+        ++redone;
+    }
+
+    auto redoEnd = std::chrono::steady_clock::now();
+    ok = ok && redone == undone && positions(stocks) == finalPositions;
+
+    auto ns = [](std::chrono::steady_clock::duration d, size_t n) {
+        return std::chrono::duration<double, std::nano>(d).count() / std::max<size_t>(n, 1);
+    };
+
+    std::cout << "steps: " << steps << ", capacity: " << capacity << std::endl;
+    std::cout << "execute: " << ns(executed - start, steps) << " ns/step" << std::endl;
+    std::cout << "undo: " << undone << " steps, " << ns(undoEnd - executed, undone) << " ns/step" << std::endl;
+    std::cout << "redo: " << redone << " steps, " << ns(redoEnd - undoEnd, redone) << " ns/step" << std::endl;
+    std::cout << "history: " << broker.getHistory().getBytes() / double(1 << 20) << " MB (" << sizeof(Delta) <<
+              " bytes per step), a Stock snapshot per step would need " << sizeof(Stock) * std::min(steps, capacity) /
+              double(1 << 20) << " MB plus the name strings" << std::endl;
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        size_t steps = argc > 2 ? std::stoul(argv[2]) : 10000000;
+        return bench(steps, argc > 3 ? std::stoul(argv[3]) : steps);
+    }
+
+    std::vector<Stock> stocks;
+    stocks.push_back(Stock(0, "ABC"));
+    Stock& abcStock = stocks[0];
+
+    std::shared_ptr<BuyStock> buyStockOrder = std::make_shared<BuyStock>(abcStock);
+    std::shared_ptr<SellStock> sellStockOrder = std::make_shared<SellStock>(abcStock, 2);
+
+    Broker broker = Broker(stocks);
+    broker.takeOrder(buyStockOrder);
+    broker.takeOrder(sellStockOrder);
+    broker.placeOrders();
+    std::cout << "Position: " << abcStock.getPosition() << std::endl;
+
+    std::cout << "Undo:" << std::endl;
+    broker.undo();
+    std::cout << "Position: " << abcStock.getPosition() << std::endl;
+
+    std::cout << "Redo:" << std::endl;
+    broker.redo();
+    std::cout << "Position: " << abcStock.getPosition() << std::endl;
+
+    broker.takeOrder(std::make_shared<PrintOrder>("--- irreversible ---"));
+    broker.placeOrders();
+    std::cout << "Can undo after an irreversible order? " << broker.getHistory().canUndo() << std::endl;
+
+    return 0;
+}
@@ -8,15 +8,23 @@
 #include <algorithm>
 #include <list>
 #include <memory>
+#include <unordered_set>
+#include <vector>
 
 class Person {
 public:
     Person(std::string name, std::string gender, std::string maritalStatus) {
+        m_id = s_nextId++;
         m_name = name;
         m_gender = gender;
         m_maritalStatus = maritalStatus;
     }
 
+    //行号在构造时分配，拷贝后保持不变，用于在不同结果列表之间识别同一个人
+    size_t getId() const {
+        return m_id;
+    }
+
     std::string getName() const {
         return m_name;
     }
@@ -30,11 +38,16 @@ public:
     }
 
 private:
+    static size_t s_nextId;
+
+    size_t m_id;
     std::string m_name;
     std::string m_gender;
     std::string m_maritalStatus;
 };
 
+size_t Person::s_nextId = 0;
+
 class Criteria {
 public:
     virtual std::list<Person> meetCriteria(std::list<Person> persons) = 0;
@@ -108,28 +121,33 @@ private:
 
 class OrCriteria: public Criteria {
 public:
+    //按行号求并集：先收集各个子条件命中的行号，再按输入顺序扫描一遍，整体为线性复杂度
     virtual std::list<Person> meetCriteria(std::list<Person> persons) override {
-        std::list<Person> firstCriteriaPersons = m_criteria.meetCriteria(persons);
-        std::list<Person> otherCriteriaPersons = m_otherCriteria.meetCriteria(persons);
-
-        for (auto person : otherCriteriaPersons) {
-            if (std::find_if(firstCriteriaPersons.begin(), firstCriteriaPersons.end(),
-            [person](Person p) {
-            return person.getName() == p.getName();
-            }) == firstCriteriaPersons.end()) {
-                firstCriteriaPersons.push_back(person);
+        std::unordered_set<size_t> ids;
+
+        for (auto criteria : m_criterias) {
+            for (auto& person : criteria->meetCriteria(persons)) {
+                ids.insert(person.getId());
+            }
+        }
+
+        std::list<Person> result;
+
+        for (auto& person : persons) {
+            if (ids.count(person.getId()) != 0) {
+                result.push_back(person);
             }
         }
 
-        return firstCriteriaPersons;
+        return result;
     }
 
-    OrCriteria(Criteria& criteria, Criteria& otherCriteria) : m_criteria(criteria),
-        m_otherCriteria(otherCriteria) {}
+    OrCriteria(Criteria& criteria, Criteria& otherCriteria) : m_criterias{&criteria, &otherCriteria} {}
+
+    OrCriteria(std::vector<Criteria*> criterias) : m_criterias(criterias) {}
 
 private:
-    Criteria& m_criteria;
-    Criteria& m_otherCriteria;
+    std::vector<Criteria*> m_criterias;
 };
 
 void printPersons(std::list<Person> persons) {
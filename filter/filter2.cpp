@@ -6,8 +6,13 @@
 
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
 #include <list>
 #include <memory>
+#include <unordered_set>
+#include <vector>
 
 class Person {
 public:
@@ -17,15 +22,15 @@ public:
         m_maritalStatus = maritalStatus;
     }
 
-    std::string getName() const {
+    const std::string& getName() const {
         return m_name;
     }
 
-    std::string getGender() const {
+    const std::string& getGender() const {
         return m_gender;
     }
 
-    std::string getMaritalStatus() const {
+    const std::string& getMaritalStatus() const {
         return m_maritalStatus;
     }
 
@@ -38,9 +43,39 @@ private:
 using lsp_t = std::list<std::shared_ptr<Person>>;
 using slsp_t = std::shared_ptr<std::list<std::shared_ptr<Person>>>;
 
+//选择向量模式：persons 只读，sel_t 保存满足条件的行下标（升序），每个条件在原地收缩它
+using vsp_t = std::vector<std::shared_ptr<Person>>;
+using sel_t = std::vector<size_t>;
+
+//Or/Not 需要的临时选择向量从这里按栈的方式借用，缓冲区在多次查询之间复用，预热后不再分配内存
+class SelectionContext {
+public:
+    SelectionContext() : m_depth(0) {}
+
+    sel_t& acquire() {
+        if (m_depth == m_buffers.size()) {
+            m_buffers.emplace_back();
+        }
+
+        sel_t& buffer = m_buffers[m_depth++];
+        buffer.clear();
+        return buffer;
+    }
+
+    void release() {
+        --m_depth;
+    }
+
+private:
+    std::deque<sel_t> m_buffers;
+    size_t m_depth;
+};
+
 class Criteria {
 public:
     virtual slsp_t meetCriteria(slsp_t persons) = 0;
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext& context) = 0;
+    virtual ~Criteria() = default;
 };
 
 class CriteriaMale: public Criteria {
@@ -56,6 +91,18 @@ public:
 
         return list;
     }
+
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext&) override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row]->getGender() == "Male") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
 };
 
 class CriteriaFemale: public Criteria {
@@ -71,6 +118,18 @@ public:
 
         return list;
     }
+
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext&) override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row]->getGender() == "Female") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
 };
 
 class CriteriaSingle: public Criteria {
@@ -86,6 +145,18 @@ public:
 
         return list;
     }
+
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext&) override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row]->getMaritalStatus() == "Single") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
 };
 
 class AndCriteria: public Criteria {
@@ -95,6 +166,11 @@ public:
         return m_otherCriteria->meetCriteria(firstCriteriaPersons);
     }
 
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext& context) override {
+        m_criteria->refine(persons, selection, context);
+        m_otherCriteria->refine(persons, selection, context);
+    }
+
     AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) {
         m_criteria = criteria;
         m_otherCriteria = otherCriteria;
@@ -107,30 +183,134 @@ private:
 
 class OrCriteria: public Criteria {
 public:
+    //共享同一个 Person 对象的指针就是稳定的行标识：收集各个子条件命中的指针，再按输入顺序扫描一遍，
+    //整体为线性复杂度，并且结果保持输入顺序
     virtual slsp_t meetCriteria(slsp_t persons) override {
-        slsp_t firstCriteriaPersons = m_criteria->meetCriteria(persons);
-        slsp_t otherCriteriaPersons = m_otherCriteria->meetCriteria(persons);
-
-        for (auto person : *otherCriteriaPersons) {
-            if (std::find_if((*firstCriteriaPersons).begin(), (*firstCriteriaPersons).end(),
-            [person](std::shared_ptr<Person> p) {
-            return person->getName() == p->getName();
-            }) == (*firstCriteriaPersons).end()) {
-                (*firstCriteriaPersons).push_back(person);
+        std::unordered_set<const Person*> matched;
+
+        for (auto criteria : m_criterias) {
+            slsp_t criteriaPersons = criteria->meetCriteria(persons);
+
+            for (auto it = criteriaPersons->begin(); it != criteriaPersons->end(); ++it) {
+                matched.insert(it->get());
             }
         }
 
-        return firstCriteriaPersons;
+        slsp_t list = std::make_shared<lsp_t>();
+
+        for (auto it = persons->begin(); it != persons->end(); ++it) {
+            if (matched.count(it->get()) != 0) {
+                list->push_back(*it);
+            }
+        }
+
+        return list;
+    }
+
+    //每个子条件只处理尚未命中的候选行，再把结果归并回 selection，保持升序
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext& context) override {
+        sel_t& candidates = context.acquire();
+        sel_t& part = context.acquire();
+        sel_t& merged = context.acquire();
+        candidates.swap(selection);
+
+        for (auto criteria : m_criterias) {
+            part.clear();
+            std::set_difference(candidates.begin(), candidates.end(), selection.begin(), selection.end(),
+                                std::back_inserter(part));
+            criteria->refine(persons, part, context);
+            merged.clear();
+            std::merge(selection.begin(), selection.end(), part.begin(), part.end(),
+                       std::back_inserter(merged));
+            selection.swap(merged);
+        }
+
+        context.release();
+        context.release();
+        context.release();
     }
 
     OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) {
-        m_criteria = criteria;
-        m_otherCriteria = otherCriteria;
+        m_criterias.push_back(criteria);
+        m_criterias.push_back(otherCriteria);
+    }
+
+    OrCriteria(std::vector<std::shared_ptr<Criteria>> criterias) : m_criterias(criterias) {}
+
+private:
+    std::vector<std::shared_ptr<Criteria>> m_criterias;
+};
+
+class NotCriteria: public Criteria {
+public:
+    NotCriteria(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    virtual slsp_t meetCriteria(slsp_t persons) override {
+        slsp_t criteriaPersons = m_criteria->meetCriteria(persons);
+        std::unordered_set<const Person*> matched;
+
+        for (auto it = criteriaPersons->begin(); it != criteriaPersons->end(); ++it) {
+            matched.insert(it->get());
+        }
+
+        slsp_t list = std::make_shared<lsp_t>();
+
+        for (auto it = persons->begin(); it != persons->end(); ++it) {
+            if (matched.count(it->get()) == 0) {
+                list->push_back(*it);
+            }
+        }
+
+        return list;
+    }
+
+    //两个有序下标序列求差，写指针不会超过读指针，可以原地完成
+    virtual void refine(const vsp_t& persons, sel_t& selection, SelectionContext& context) override {
+        sel_t& matched = context.acquire();
+        matched.assign(selection.begin(), selection.end());
+        m_criteria->refine(persons, matched, context);
+
+        size_t n = 0;
+        size_t j = 0;
+
+        for (size_t row : selection) {
+            while (j < matched.size() && matched[j] < row) {
+                ++j;
+            }
+
+            if (j == matched.size() || matched[j] != row) {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+        context.release();
     }
 
 private:
     std::shared_ptr<Criteria> m_criteria;
-    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+//持有选择向量执行所需的全部缓冲区，重复执行查询时不再分配内存
+class SelectionExecutor {
+public:
+    SelectionExecutor(const vsp_t& persons) : m_persons(persons) {}
+
+    const sel_t& execute(Criteria& criteria) {
+        m_selection.resize(m_persons.size());
+
+        for (size_t i = 0; i < m_selection.size(); ++i) {
+            m_selection[i] = i;
+        }
+
+        criteria.refine(m_persons, m_selection, m_context);
+        return m_selection;
+    }
+
+private:
+    const vsp_t& m_persons;
+    sel_t m_selection;
+    SelectionContext m_context;
 };
 
 void printPersons(slsp_t persons) {
@@ -141,7 +321,119 @@ void printPersons(slsp_t persons) {
 
 }
 
-int main() {
+void printPersons(const vsp_t& persons, const sel_t& selection) {
+    for (size_t row : selection) {
+        std::cout << "Person : [ Name : " << persons[row]->getName() << ", Gender : " <<
+                  persons[row]->getGender() << ", Marital Status : " << persons[row]->getMaritalStatus() << " ]" <<
+                  std::endl;
+    }
+}
+
+//原先 OrCriteria 的去重方式，仅用于性能对比
+static slsp_t findIfUnion(slsp_t firstCriteriaPersons, slsp_t otherCriteriaPersons) {
+    for (auto person : *otherCriteriaPersons) {
+        if (std::find_if(firstCriteriaPersons->begin(), firstCriteriaPersons->end(),
+        [person](std::shared_ptr<Person> p) {
+        return person->getName() == p->getName();
+        }) == firstCriteriaPersons->end()) {
+            firstCriteriaPersons->push_back(person);
+        }
+    }
+
+    return firstCriteriaPersons;
+}
+
+static int benchUnion() {
+    std::shared_ptr<CriteriaMale> male(new CriteriaMale());
+    std::shared_ptr<CriteriaSingle> single(new CriteriaSingle());
+    std::shared_ptr<OrCriteria> singleOrMale(new OrCriteria(single, male));
+
+    std::cout << "rows\tOrCriteria(us)\tns/row\tfind_if(us)" << std::endl;
+
+    for (size_t rows = 1 << 12; rows <= (1 << 20); rows <<= 2) {
+        slsp_t persons = std::make_shared<lsp_t>();
+
+        for (size_t i = 0; i < rows; ++i) {
+            persons->push_back(std::make_shared<Person>("Person" + std::to_string(i),
+                               i % 2 ? "Male" : "Female", i % 3 ? "Married" : "Single"));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t count = singleOrMale->meetCriteria(persons)->size();
+        auto end = std::chrono::steady_clock::now();
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        std::cout << rows << "\t" << us << "\t" << us * 1000.0 / rows << "\t";
+
+        //平方复杂度的旧实现只在小规模下运行
+        if (rows <= (1 << 14)) {
+            start = std::chrono::steady_clock::now();
+            size_t legacyCount = findIfUnion(single->meetCriteria(persons),
+                                             male->meetCriteria(persons))->size();
+            end = std::chrono::steady_clock::now();
+            std::cout << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+            if (legacyCount != count) {
+                std::cout << std::endl << "result mismatch" << std::endl;
+                return 1;
+            }
+        } else {
+            std::cout << "-";
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+static int benchSelection() {
+    std::shared_ptr<Criteria> male(new CriteriaMale());
+    std::shared_ptr<Criteria> female(new CriteriaFemale());
+    std::shared_ptr<Criteria> single(new CriteriaSingle());
+    std::shared_ptr<Criteria> singleMale(new AndCriteria(single, male));
+    std::shared_ptr<Criteria> singleOrFemale(new OrCriteria(single, female));
+    std::shared_ptr<Criteria> query(new AndCriteria(singleOrFemale,
+                                    std::make_shared<NotCriteria>(singleMale)));
+
+    std::cout << "rows\tlist(us)\tselection(us)" << std::endl;
+
+    for (size_t rows = 1 << 12; rows <= (1 << 20); rows <<= 2) {
+        slsp_t persons = std::make_shared<lsp_t>();
+
+        for (size_t i = 0; i < rows; ++i) {
+            persons->push_back(std::make_shared<Person>("Person" + std::to_string(i),
+                               i % 2 ? "Male" : "Female", i % 3 ? "Married" : "Single"));
+        }
+
+        vsp_t rowsVector(persons->begin(), persons->end());
+        SelectionExecutor executor(rowsVector);
+        executor.execute(*query);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t listCount = query->meetCriteria(persons)->size();
+        auto middle = std::chrono::steady_clock::now();
+        size_t selectionCount = executor.execute(*query).size();
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << rows << "\t" << std::chrono::duration_cast<std::chrono::microseconds>
+                  (middle - start).count() << "\t" << std::chrono::duration_cast<std::chrono::microseconds>
+                  (end - middle).count() << std::endl;
+
+        if (listCount != selectionCount) {
+            std::cout << "result mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return benchUnion() || benchSelection();
+    }
+
     slsp_t persons = std::make_shared<lsp_t>();
     persons->push_back(std::shared_ptr<Person>(new Person("Robert", "Male", "Single")));
     persons->push_back(std::shared_ptr<Person>(new Person("John", "Male", "Married")));
@@ -157,6 +449,7 @@ int main() {
     std::shared_ptr<CriteriaSingle> single(new CriteriaSingle());
     std::shared_ptr<AndCriteria> singleMale(new AndCriteria(single, male));
     std::shared_ptr<OrCriteria> singleOrFemale(new OrCriteria(single, female));
+    std::shared_ptr<OrCriteria> femaleOrSingleOrMale(new OrCriteria({female, single, male}));
 
     std::cout << "\nMale:" << std::endl;
     printPersons(male->meetCriteria(persons));
@@ -173,5 +466,21 @@ int main() {
     std::cout << "\nSingle Or Female:" << std::endl;
     printPersons(singleOrFemale->meetCriteria(persons));
 
+    std::cout << "\nFemale Or Single Or Male:" << std::endl;
+    printPersons(femaleOrSingleOrMale->meetCriteria(persons));
+
+    //选择向量模式：结果只是下标视图，不复制 Person
+    vsp_t rows(persons->begin(), persons->end());
+    SelectionExecutor executor(rows);
+    std::shared_ptr<NotCriteria> notSingleMale(new NotCriteria(singleMale));
+    std::shared_ptr<AndCriteria> singleOrFemaleNotSingleMale(new AndCriteria(singleOrFemale,
+            notSingleMale));
+
+    std::cout << "\nSingle Male (selection):" << std::endl;
+    printPersons(rows, executor.execute(*singleMale));
+
+    std::cout << "\n(Single Or Female) And Not Single Male (selection):" << std::endl;
+    printPersons(rows, executor.execute(*singleOrFemaleNotSingleMale));
+
     return 0;
 }
\ No newline at end of file
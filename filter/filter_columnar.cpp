@@ -0,0 +1,373 @@
+/**
+ * 过滤器模式（Filter Pattern）的列式实现
+ *
+ * filter.cpp 中每个 Criteria 都会把满足条件的 Person（三个 std::string）复制到新的 std::list 中，
+ * 并且通过字符串比较性别与婚姻状况，数据量很大时内存分配与指针跳转会成为主要开销。
+ *
+ * 这里把人员数据按列存储（struct-of-arrays）：
+ *      1、姓名统一存放在一块连续内存中，按偏移量访问。
+ *      2、性别、婚姻状况做字典编码，每行只占一个字节，并且为每个取值维护一个位图。
+ *      3、Criteria 的结果是位图，AndCriteria/OrCriteria 变成按 64 位字的与/或运算，不再生成中间列表。
+ *
+ * 运行 `filter_columnar bench [rows]` 可以与 std::list<Person> 的实现做性能对比。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Bitmap {
+public:
+    Bitmap() : m_size(0) {}
+
+    explicit Bitmap(size_t size) : m_words((size + 63) / 64, 0), m_size(size) {}
+
+    size_t size() const {
+        return m_size;
+    }
+
+    void pushBack(bool value) {
+        if (m_size % 64 == 0) {
+            m_words.push_back(0);
+        }
+
+        if (value) {
+            m_words[m_size / 64] |= uint64_t(1) << (m_size % 64);
+        }
+
+        ++m_size;
+    }
+
+    void set(size_t pos) {
+        m_words[pos / 64] |= uint64_t(1) << (pos % 64);
+    }
+
+    bool test(size_t pos) const {
+        return (m_words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    Bitmap& operator&=(const Bitmap& other) {
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            m_words[i] &= other.m_words[i];
+        }
+
+        return *this;
+    }
+
+    Bitmap& operator|=(const Bitmap& other) {
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            m_words[i] |= other.m_words[i];
+        }
+
+        return *this;
+    }
+
+    size_t count() const {
+        size_t n = 0;
+
+        for (auto word : m_words) {
+            n += __builtin_popcountll(word);
+        }
+
+        return n;
+    }
+
+    //按行号从小到大遍历所有被置位的行
+    template <typename Func>
+    void forEach(Func func) const {
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            uint64_t word = m_words[i];
+
+            while (word != 0) {
+                func(i * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_size;
+};
+
+//字典编码的列：每行保存取值的编码，同时为每个取值维护一个位图
+class DictionaryColumn {
+public:
+    void pushBack(const std::string& value) {
+        auto it = m_codes.find(value);
+        uint8_t code;
+
+        if (it == m_codes.end()) {
+            if (m_values.size() == 256) {
+                throw std::length_error("DictionaryColumn: too many distinct values");
+            }
+
+            code = (uint8_t)m_values.size();
+            m_codes[value] = code;
+            m_values.push_back(value);
+            m_bitmaps.push_back(Bitmap(m_rows.size()));
+        } else {
+            code = it->second;
+        }
+
+        for (size_t i = 0; i < m_bitmaps.size(); ++i) {
+            m_bitmaps[i].pushBack(i == code);
+        }
+
+        m_rows.push_back(code);
+    }
+
+    const std::string& get(size_t row) const {
+        return m_values[m_rows[row]];
+    }
+
+    //取值不存在时返回全 0 的位图
+    Bitmap getBitmap(const std::string& value) const {
+        auto it = m_codes.find(value);
+
+        if (it == m_codes.end()) {
+            return Bitmap(m_rows.size());
+        }
+
+        return m_bitmaps[it->second];
+    }
+
+private:
+    std::vector<uint8_t> m_rows;
+    std::vector<std::string> m_values;
+    std::unordered_map<std::string, uint8_t> m_codes;
+    std::vector<Bitmap> m_bitmaps;
+};
+
+class PersonTable {
+public:
+    void addPerson(const std::string& name, const std::string& gender,
+                   const std::string& maritalStatus) {
+        m_nameOffsets.push_back(m_names.size());
+        m_names.insert(m_names.end(), name.begin(), name.end());
+        m_gender.pushBack(gender);
+        m_maritalStatus.pushBack(maritalStatus);
+    }
+
+    size_t size() const {
+        return m_nameOffsets.size();
+    }
+
+    std::string getName(size_t row) const {
+        size_t end = row + 1 < m_nameOffsets.size() ? m_nameOffsets[row + 1] : m_names.size();
+        return std::string(m_names.data() + m_nameOffsets[row], end - m_nameOffsets[row]);
+    }
+
+    const std::string& getGender(size_t row) const {
+        return m_gender.get(row);
+    }
+
+    const std::string& getMaritalStatus(size_t row) const {
+        return m_maritalStatus.get(row);
+    }
+
+    Bitmap getGenderBitmap(const std::string& gender) const {
+        return m_gender.getBitmap(gender);
+    }
+
+    Bitmap getMaritalStatusBitmap(const std::string& maritalStatus) const {
+        return m_maritalStatus.getBitmap(maritalStatus);
+    }
+
+private:
+    std::vector<char> m_names;
+    std::vector<size_t> m_nameOffsets;
+    DictionaryColumn m_gender;
+    DictionaryColumn m_maritalStatus;
+};
+
+class Criteria {
+public:
+    virtual Bitmap meetCriteria(const PersonTable& persons) = 0;
+    virtual ~Criteria() = default;
+};
+
+class CriteriaMale: public Criteria {
+public:
+    virtual Bitmap meetCriteria(const PersonTable& persons) override {
+        return persons.getGenderBitmap("Male");
+    }
+};
+
+class CriteriaFemale: public Criteria {
+public:
+    virtual Bitmap meetCriteria(const PersonTable& persons) override {
+        return persons.getGenderBitmap("Female");
+    }
+};
+
+class CriteriaSingle: public Criteria {
+public:
+    virtual Bitmap meetCriteria(const PersonTable& persons) override {
+        return persons.getMaritalStatusBitmap("Single");
+    }
+};
+
+class AndCriteria: public Criteria {
+public:
+    AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual Bitmap meetCriteria(const PersonTable& persons) override {
+        Bitmap result = m_criteria->meetCriteria(persons);
+        result &= m_otherCriteria->meetCriteria(persons);
+        return result;
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+class OrCriteria: public Criteria {
+public:
+    OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual Bitmap meetCriteria(const PersonTable& persons) override {
+        Bitmap result = m_criteria->meetCriteria(persons);
+        result |= m_otherCriteria->meetCriteria(persons);
+        return result;
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+void printPersons(const PersonTable& persons, const Bitmap& selected) {
+    selected.forEach([&persons](size_t row) {
+        std::cout << "Person : [ Name : " << persons.getName(row) << ", Gender : " <<
+                  persons.getGender(row) << ", Marital Status : " << persons.getMaritalStatus(row) << " ]" <<
+                  std::endl;
+    });
+}
+
+//以下为性能对比用的 std::list<Person> 实现，与 filter.cpp 相同
+class Person {
+public:
+    Person(std::string name, std::string gender, std::string maritalStatus) : m_name(name),
+        m_gender(gender), m_maritalStatus(maritalStatus) {}
+
+    std::string getGender() const {
+        return m_gender;
+    }
+
+    std::string getMaritalStatus() const {
+        return m_maritalStatus;
+    }
+
+private:
+    std::string m_name;
+    std::string m_gender;
+    std::string m_maritalStatus;
+};
+
+static std::list<Person> listSingleMale(std::list<Person> persons) {
+    std::list<Person> single;
+
+    for (auto person : persons) {
+        if (person.getMaritalStatus() == "Single") {
+            single.push_back(person);
+        }
+    }
+
+    std::list<Person> singleMale;
+
+    for (auto person : single) {
+        if (person.getGender() == "Male") {
+            singleMale.push_back(person);
+        }
+    }
+
+    return singleMale;
+}
+
+static int bench(size_t rows) {
+    const char* genders[] = {"Male", "Female"};
+    const char* statuses[] = {"Single", "Married", "Divorced"};
+
+    PersonTable table;
+    std::list<Person> persons;
+
+    for (size_t i = 0; i < rows; ++i) {
+        std::string name = "Person" + std::to_string(i);
+        table.addPerson(name, genders[i % 2], statuses[i % 3]);
+        persons.push_back(Person(name, genders[i % 2], statuses[i % 3]));
+    }
+
+    std::shared_ptr<Criteria> singleMale = std::make_shared<AndCriteria>(
+            std::make_shared<CriteriaSingle>(), std::make_shared<CriteriaMale>());
+
+    auto start = std::chrono::steady_clock::now();
+    size_t listCount = listSingleMale(persons).size();
+    auto middle = std::chrono::steady_clock::now();
+    size_t bitmapCount = singleMale->meetCriteria(table).count();
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "rows: " << rows << std::endl;
+    std::cout << "std::list<Person>: " << listCount << " matched, " <<
+              std::chrono::duration_cast<std::chrono::microseconds>(middle - start).count() << " us" << std::endl;
+    std::cout << "PersonTable bitmap: " << bitmapCount << " matched, " <<
+              std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count() << " us" << std::endl;
+
+    return listCount == bitmapCount ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000000);
+    }
+
+    PersonTable persons;
+    persons.addPerson("Robert", "Male", "Single");
+    persons.addPerson("John", "Male", "Married");
+    persons.addPerson("Laura", "Female", "Married");
+    persons.addPerson("Diana", "Female", "Single");
+    persons.addPerson("Mike", "Male", "Single");
+    persons.addPerson("Bobby", "Male", "Single");
+
+    Bitmap all(persons.size());
+
+    for (size_t i = 0; i < persons.size(); ++i) {
+        all.set(i);
+    }
+
+    printPersons(persons, all);
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::shared_ptr<Criteria> singleMale = std::make_shared<AndCriteria>(single, male);
+    std::shared_ptr<Criteria> singleOrFemale = std::make_shared<OrCriteria>(single, female);
+
+    std::cout << "\nMale:" << std::endl;
+    printPersons(persons, male->meetCriteria(persons));
+
+    std::cout << "\nFemale:" << std::endl;
+    printPersons(persons, female->meetCriteria(persons));
+
+    std::cout << "\nSingle:" << std::endl;
+    printPersons(persons, single->meetCriteria(persons));
+
+    std::cout << "\nSingle Male:" << std::endl;
+    printPersons(persons, singleMale->meetCriteria(persons));
+
+    std::cout << "\nSingle Or Female:" << std::endl;
+    printPersons(persons, singleOrFemale->meetCriteria(persons));
+
+    return 0;
+}
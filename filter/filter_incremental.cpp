@@ -0,0 +1,379 @@
+/**
+ * 过滤器模式（Filter Pattern）的增量维护
+ *
+ * 每次 meetCriteria 都会重新扫描全部人员，即使上次查询之后只有少数 Person 发生了变化。
+ * 这里把常用的 Criteria 注册成常驻查询（MaterializedView），PersonStore 在增加、删除、修改人员时
+ * 只对发生变化的那个人重新判断每个常驻查询，增量地更新结果集。
+ *
+ * 读取结果的代价只与结果集大小有关，与总人数无关；每次修改的代价与常驻查询的数量有关。
+ * 结果集删除元素时与末尾元素交换，所以结果的顺序不保证与插入顺序一致。
+ *
+ * 运行 `filter_incremental bench [rows]` 对比增量维护与每次重新扫描的耗时。
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Person {
+public:
+    Person(std::string name, std::string gender, std::string maritalStatus) : m_name(name),
+        m_gender(gender), m_maritalStatus(maritalStatus) {}
+
+    const std::string& getName() const {
+        return m_name;
+    }
+
+    const std::string& getGender() const {
+        return m_gender;
+    }
+
+    const std::string& getMaritalStatus() const {
+        return m_maritalStatus;
+    }
+
+private:
+    std::string m_name;
+    std::string m_gender;
+    std::string m_maritalStatus;
+};
+
+//增量维护需要逐行判断，所以 Criteria 直接判断单个 Person
+class Criteria {
+public:
+    virtual bool matches(const Person& person) const = 0;
+    virtual ~Criteria() = default;
+};
+
+class CriteriaMale: public Criteria {
+public:
+    virtual bool matches(const Person& person) const override {
+        return person.getGender() == "Male";
+    }
+};
+
+class CriteriaFemale: public Criteria {
+public:
+    virtual bool matches(const Person& person) const override {
+        return person.getGender() == "Female";
+    }
+};
+
+class CriteriaSingle: public Criteria {
+public:
+    virtual bool matches(const Person& person) const override {
+        return person.getMaritalStatus() == "Single";
+    }
+};
+
+class AndCriteria: public Criteria {
+public:
+    AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual bool matches(const Person& person) const override {
+        return m_criteria->matches(person) && m_otherCriteria->matches(person);
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+class OrCriteria: public Criteria {
+public:
+    OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual bool matches(const Person& person) const override {
+        return m_criteria->matches(person) || m_otherCriteria->matches(person);
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+class NotCriteria: public Criteria {
+public:
+    NotCriteria(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    virtual bool matches(const Person& person) const override {
+        return !m_criteria->matches(person);
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+};
+
+//常驻查询的结果集：ids 紧凑存放便于遍历，positions 记录每个 id 的位置，插入删除都是 O(1)
+class MaterializedView {
+public:
+    MaterializedView(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    const std::vector<size_t>& getIds() const {
+        return m_ids;
+    }
+
+    size_t size() const {
+        return m_ids.size();
+    }
+
+    bool contains(size_t id) const {
+        return m_positions.count(id) != 0;
+    }
+
+private:
+    friend class PersonStore;
+
+    void onInsert(size_t id, const Person& person) {
+        if (m_criteria->matches(person)) {
+            add(id);
+        }
+    }
+
+    void onRemove(size_t id) {
+        auto it = m_positions.find(id);
+
+        if (it == m_positions.end()) {
+            return;
+        }
+
+        size_t position = it->second;
+        m_positions.erase(it);
+
+        if (position != m_ids.size() - 1) {
+            m_ids[position] = m_ids.back();
+            m_positions[m_ids[position]] = position;
+        }
+
+        m_ids.pop_back();
+    }
+
+    void onUpdate(size_t id, const Person& person) {
+        bool matched = m_criteria->matches(person);
+
+        if (matched && !contains(id)) {
+            add(id);
+        } else if (!matched) {
+            onRemove(id);
+        }
+    }
+
+    void add(size_t id) {
+        m_positions[id] = m_ids.size();
+        m_ids.push_back(id);
+    }
+
+    std::shared_ptr<Criteria> m_criteria;
+    std::vector<size_t> m_ids;
+    std::unordered_map<size_t, size_t> m_positions;
+};
+
+class PersonStore {
+public:
+    PersonStore() : m_nextId(0) {}
+
+    size_t addPerson(const Person& person) {
+        size_t id = m_nextId++;
+        m_persons.insert(std::make_pair(id, person));
+
+        for (auto view : m_views) {
+            view->onInsert(id, person);
+        }
+
+        return id;
+    }
+
+    void removePerson(size_t id) {
+        if (m_persons.erase(id) == 0) {
+            throw std::out_of_range("no person with id " + std::to_string(id));
+        }
+
+        for (auto view : m_views) {
+            view->onRemove(id);
+        }
+    }
+
+    void updatePerson(size_t id, const Person& person) {
+        auto it = m_persons.find(id);
+
+        if (it == m_persons.end()) {
+            throw std::out_of_range("no person with id " + std::to_string(id));
+        }
+
+        it->second = person;
+
+        for (auto view : m_views) {
+            view->onUpdate(id, person);
+        }
+    }
+
+    const Person& getPerson(size_t id) const {
+        return m_persons.at(id);
+    }
+
+    size_t size() const {
+        return m_persons.size();
+    }
+
+    //注册常驻查询，注册时扫描一次现有人员，之后随修改增量更新
+    std::shared_ptr<MaterializedView> registerQuery(std::shared_ptr<Criteria> criteria) {
+        std::shared_ptr<MaterializedView> view = std::make_shared<MaterializedView>(criteria);
+
+        for (auto& entry : m_persons) {
+            view->onInsert(entry.first, entry.second);
+        }
+
+        m_views.push_back(view);
+        return view;
+    }
+
+    void unregisterQuery(std::shared_ptr<MaterializedView> view) {
+        for (auto it = m_views.begin(); it != m_views.end(); ++it) {
+            if (*it == view) {
+                m_views.erase(it);
+                return;
+            }
+        }
+    }
+
+    //重新扫描全部人员，仅用于对比
+    size_t scan(const Criteria& criteria) const {
+        size_t count = 0;
+
+        for (auto& entry : m_persons) {
+            if (criteria.matches(entry.second)) {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+private:
+    size_t m_nextId;
+    std::unordered_map<size_t, Person> m_persons;
+    std::vector<std::shared_ptr<MaterializedView>> m_views;
+};
+
+void printPersons(const PersonStore& store, const MaterializedView& view) {
+    for (size_t id : view.getIds()) {
+        const Person& person = store.getPerson(id);
+        std::cout << "Person : [ Name : " << person.getName() << ", Gender : " <<
+                  person.getGender() << ", Marital Status : " << person.getMaritalStatus() << " ]" << std::endl;
+    }
+}
+
+static int bench(size_t rows) {
+    const char* genders[] = {"Male", "Female"};
+    const char* statuses[] = {"Single", "Married", "Divorced"};
+
+    PersonStore store;
+
+    for (size_t i = 0; i < rows; ++i) {
+        store.addPerson(Person("Person" + std::to_string(i), genders[i % 2], statuses[i % 3]));
+    }
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::vector<std::shared_ptr<Criteria>> queries = {
+        male, female, single,
+        std::make_shared<AndCriteria>(single, male),
+        std::make_shared<OrCriteria>(single, female),
+        std::make_shared<NotCriteria>(single)
+    };
+    std::vector<std::shared_ptr<MaterializedView>> views;
+
+    for (auto query : queries) {
+        views.push_back(store.registerQuery(query));
+    }
+
+    std::default_random_engine engine;
+    std::uniform_int_distribution<size_t> pick(0, rows - 1);
+    const int rounds = 100;
+    const int changesPerRound = 10;
+    size_t incrementalTotal = 0;
+    size_t scanTotal = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int i = 0; i < changesPerRound; ++i) {
+            size_t id = pick(engine);
+            store.updatePerson(id, Person("Person" + std::to_string(id), genders[(id + round) % 2],
+                                          statuses[(id + round) % 3]));
+        }
+
+        for (auto view : views) {
+            incrementalTotal += view->size();
+        }
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    //只重新扫描少数几轮，估算每轮的耗时
+    const int scanRounds = 3;
+
+    for (int round = 0; round < scanRounds; ++round) {
+        for (auto query : queries) {
+            scanTotal += store.scan(*query);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "rows: " << rows << ", standing queries: " << queries.size() << ", changes per round: " <<
+              changesPerRound << std::endl;
+    std::cout << "incremental: " << std::chrono::duration<double, std::micro>(middle - start).count() /
+              rounds << " us/round" << std::endl;
+    std::cout << "rescan: " << std::chrono::duration<double, std::micro>(end - middle).count() /
+              scanRounds << " us/round" << std::endl;
+
+    //最后一轮之后两种方式的结果集大小必须一致
+    size_t incrementalLast = 0;
+
+    for (auto view : views) {
+        incrementalLast += view->size();
+    }
+
+    return incrementalLast * scanRounds == scanTotal && incrementalTotal > 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000000);
+    }
+
+    PersonStore store;
+    size_t robert = store.addPerson(Person("Robert", "Male", "Single"));
+    size_t john = store.addPerson(Person("John", "Male", "Married"));
+    store.addPerson(Person("Laura", "Female", "Married"));
+    store.addPerson(Person("Diana", "Female", "Single"));
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::shared_ptr<MaterializedView> singleMale = store.registerQuery(
+                std::make_shared<AndCriteria>(single, male));
+
+    std::cout << "Single Male:" << std::endl;
+    printPersons(store, *singleMale);
+
+    store.addPerson(Person("Mike", "Male", "Single"));
+    store.addPerson(Person("Bobby", "Male", "Single"));
+    store.updatePerson(john, Person("John", "Male", "Single"));
+    store.removePerson(robert);
+
+    std::cout << "\nSingle Male after adding Mike and Bobby, updating John and removing Robert:" <<
+              std::endl;
+    printPersons(store, *singleMale);
+
+    return 0;
+}
@@ -0,0 +1,490 @@
+/**
+ * 过滤器模式（Filter Pattern）的多线程分块执行
+ *
+ * 把人员数据按缓存大小切成若干块，每一块作为一个任务交给工作窃取（work-stealing）线程池，
+ * 各线程在块内用选择向量（见 filter2.cpp）执行任意 Criteria 组合，最后按块的顺序拼接结果，
+ * 因此输出顺序与输入顺序一致。
+ *
+ * Criteria 在多个线程中同时执行，实现时不能修改自身状态。
+ *
+ * 运行 `filter_parallel bench [rows]` 输出 1 到 N 个线程的吞吐量。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Person {
+public:
+    Person(std::string name, std::string gender, std::string maritalStatus) : m_name(name),
+        m_gender(gender), m_maritalStatus(maritalStatus) {}
+
+    const std::string& getName() const {
+        return m_name;
+    }
+
+    const std::string& getGender() const {
+        return m_gender;
+    }
+
+    const std::string& getMaritalStatus() const {
+        return m_maritalStatus;
+    }
+
+private:
+    std::string m_name;
+    std::string m_gender;
+    std::string m_maritalStatus;
+};
+
+using sel_t = std::vector<size_t>;
+
+class SelectionContext {
+public:
+    SelectionContext() : m_depth(0) {}
+
+    sel_t& acquire() {
+        if (m_depth == m_buffers.size()) {
+            m_buffers.emplace_back();
+        }
+
+        sel_t& buffer = m_buffers[m_depth++];
+        buffer.clear();
+        return buffer;
+    }
+
+    void release() {
+        --m_depth;
+    }
+
+private:
+    std::deque<sel_t> m_buffers;
+    size_t m_depth;
+};
+
+class Criteria {
+public:
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext& context) const = 0;
+    virtual ~Criteria() = default;
+};
+
+class CriteriaMale: public Criteria {
+public:
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getGender() == "Male") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class CriteriaFemale: public Criteria {
+public:
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getGender() == "Female") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class CriteriaSingle: public Criteria {
+public:
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getMaritalStatus() == "Single") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class AndCriteria: public Criteria {
+public:
+    AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        m_criteria->refine(persons, selection, context);
+        m_otherCriteria->refine(persons, selection, context);
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+class OrCriteria: public Criteria {
+public:
+    OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criterias{criteria, otherCriteria} {}
+
+    OrCriteria(std::vector<std::shared_ptr<Criteria>> criterias) : m_criterias(criterias) {}
+
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        sel_t& candidates = context.acquire();
+        sel_t& part = context.acquire();
+        sel_t& merged = context.acquire();
+        candidates.swap(selection);
+
+        for (auto criteria : m_criterias) {
+            part.clear();
+            std::set_difference(candidates.begin(), candidates.end(), selection.begin(), selection.end(),
+                                std::back_inserter(part));
+            criteria->refine(persons, part, context);
+            merged.clear();
+            std::merge(selection.begin(), selection.end(), part.begin(), part.end(),
+                       std::back_inserter(merged));
+            selection.swap(merged);
+        }
+
+        context.release();
+        context.release();
+        context.release();
+    }
+
+private:
+    std::vector<std::shared_ptr<Criteria>> m_criterias;
+};
+
+class NotCriteria: public Criteria {
+public:
+    NotCriteria(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    virtual void refine(const std::vector<Person>& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        sel_t& matched = context.acquire();
+        matched.assign(selection.begin(), selection.end());
+        m_criteria->refine(persons, matched, context);
+
+        size_t n = 0;
+        size_t j = 0;
+
+        for (size_t row : selection) {
+            while (j < matched.size() && matched[j] < row) {
+                ++j;
+            }
+
+            if (j == matched.size() || matched[j] != row) {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+        context.release();
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+};
+
+//工作窃取线程池：每个线程有自己的任务队列，从队首取任务，空闲时从其他线程的队尾窃取
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threads) : m_remaining(0), m_generation(0), m_stop(false) {
+        threads = std::max<size_t>(threads, 1);
+
+        for (size_t i = 0; i < threads; ++i) {
+            m_queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+        }
+
+        for (size_t i = 0; i < threads; ++i) {
+            m_threads.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_cond.notify_all();
+
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    size_t size() const {
+        return m_threads.size();
+    }
+
+    //执行任务 [0, tasks)，func 的参数为线程编号与任务编号，全部完成后返回
+    void run(size_t tasks, std::function<void(size_t, size_t)> func) {
+        if (tasks == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_func = func;
+            m_remaining = tasks;
+        }
+
+        //相邻的块先分给同一个线程，保持访问的局部性
+        for (size_t i = 0; i < m_queues.size(); ++i) {
+            std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+
+            for (size_t task = tasks * i / m_queues.size(); task < tasks * (i + 1) / m_queues.size(); ++task) {
+                m_queues[i]->tasks.push_back(task);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_generation;
+        }
+
+        m_cond.notify_all();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCond.wait(lock, [this] {
+            return m_remaining == 0;
+        });
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    bool popTask(size_t worker, size_t& task) {
+        {
+            std::lock_guard<std::mutex> lock(m_queues[worker]->mutex);
+
+            if (!m_queues[worker]->tasks.empty()) {
+                task = m_queues[worker]->tasks.front();
+                m_queues[worker]->tasks.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < m_queues.size(); ++i) {
+            TaskQueue& victim = *m_queues[(worker + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void workerLoop(size_t worker) {
+        size_t generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this, generation] {
+                    return m_stop || m_generation != generation;
+                });
+
+                if (m_stop) {
+                    return;
+                }
+
+                generation = m_generation;
+            }
+
+            size_t task;
+
+            while (popTask(worker, task)) {
+                m_func(worker, task);
+
+                if (--m_remaining == 0) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_doneCond.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::function<void(size_t, size_t)> m_func;
+    std::atomic<size_t> m_remaining;
+    size_t m_generation;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_doneCond;
+};
+
+class ParallelEvaluator {
+public:
+    //默认每块 4096 行，约等于一个 Person 数组片段放进 L2 缓存的大小
+    ParallelEvaluator(WorkStealingPool& pool, size_t chunkRows = 4096) : m_pool(pool),
+        m_chunkRows(std::max<size_t>(chunkRows, 1)), m_contexts(pool.size()) {}
+
+    const sel_t& evaluate(const Criteria& criteria, const std::vector<Person>& persons) {
+        size_t chunks = (persons.size() + m_chunkRows - 1) / m_chunkRows;
+
+        if (m_chunkResults.size() < chunks) {
+            m_chunkResults.resize(chunks);
+        }
+
+        m_pool.run(chunks, [this, &criteria, &persons](size_t worker, size_t chunk) {
+            sel_t& selection = m_chunkResults[chunk];
+            size_t begin = chunk * m_chunkRows;
+            size_t end = std::min(begin + m_chunkRows, persons.size());
+            selection.resize(end - begin);
+
+            for (size_t i = 0; i < selection.size(); ++i) {
+                selection[i] = begin + i;
+            }
+
+            criteria.refine(persons, selection, m_contexts[worker]);
+        });
+
+        //按块的顺序拼接，结果与输入顺序一致
+        m_result.clear();
+
+        for (size_t i = 0; i < chunks; ++i) {
+            m_result.insert(m_result.end(), m_chunkResults[i].begin(), m_chunkResults[i].end());
+        }
+
+        return m_result;
+    }
+
+private:
+    WorkStealingPool& m_pool;
+    size_t m_chunkRows;
+    std::vector<SelectionContext> m_contexts;
+    std::vector<sel_t> m_chunkResults;
+    sel_t m_result;
+};
+
+void printPersons(const std::vector<Person>& persons, const sel_t& selection) {
+    for (size_t row : selection) {
+        std::cout << "Person : [ Name : " << persons[row].getName() << ", Gender : " <<
+                  persons[row].getGender() << ", Marital Status : " << persons[row].getMaritalStatus() << " ]" <<
+                  std::endl;
+    }
+}
+
+static int bench(size_t rows) {
+    std::vector<Person> persons;
+    persons.reserve(rows);
+
+    for (size_t i = 0; i < rows; ++i) {
+        persons.push_back(Person("Person" + std::to_string(i), i % 2 ? "Male" : "Female",
+                                 i % 3 ? "Married" : "Single"));
+    }
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::shared_ptr<Criteria> query = std::make_shared<AndCriteria>(
+                                          std::make_shared<OrCriteria>(single, female),
+                                          std::make_shared<NotCriteria>(std::make_shared<AndCriteria>(single, male)));
+
+    size_t maxThreads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    std::vector<size_t> threadCounts;
+
+    for (size_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "rows: " << rows << std::endl;
+    std::cout << "threads\tmatched\tms\tMrows/s" << std::endl;
+    size_t expected = 0;
+
+    for (size_t threads : threadCounts) {
+        WorkStealingPool pool(threads);
+        ParallelEvaluator evaluator(pool);
+        evaluator.evaluate(*query, persons);
+
+        const int rounds = 5;
+        size_t matched = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < rounds; ++i) {
+            matched = evaluator.evaluate(*query, persons).size();
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / rounds;
+
+        std::cout << threads << "\t" << matched << "\t" << ms << "\t" << rows / ms / 1000 << std::endl;
+
+        if (expected != 0 && matched != expected) {
+            std::cout << "result mismatch" << std::endl;
+            return 1;
+        }
+
+        expected = matched;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 4000000);
+    }
+
+    std::vector<Person> persons;
+    persons.push_back(Person("Robert", "Male", "Single"));
+    persons.push_back(Person("John", "Male", "Married"));
+    persons.push_back(Person("Laura", "Female", "Married"));
+    persons.push_back(Person("Diana", "Female", "Single"));
+    persons.push_back(Person("Mike", "Male", "Single"));
+    persons.push_back(Person("Bobby", "Male", "Single"));
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::shared_ptr<Criteria> singleMale = std::make_shared<AndCriteria>(single, male);
+    std::shared_ptr<Criteria> singleOrFemale = std::make_shared<OrCriteria>(single, female);
+
+    //演示时每块只放两行，让多个线程都能分到任务
+    WorkStealingPool pool(4);
+    ParallelEvaluator evaluator(pool, 2);
+
+    std::cout << "Single Male:" << std::endl;
+    printPersons(persons, evaluator.evaluate(*singleMale, persons));
+
+    std::cout << "\nSingle Or Female:" << std::endl;
+    printPersons(persons, evaluator.evaluate(*singleOrFemale, persons));
+
+    return 0;
+}
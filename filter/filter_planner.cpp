@@ -0,0 +1,585 @@
+/**
+ * 过滤器模式（Filter Pattern）的查询计划
+ *
+ * AndCriteria(single, male) 总是先在全部输入上执行 single。如果先执行选择性更高的条件，
+ * 后面的条件需要扫描的行就少得多。这里在 Criteria 组合之上加一个简单的查询优化器：
+ *      1、Statistics 统计每一列每个取值的行数，据此估算每个条件的选择率（假设各列相互独立）。
+ *      2、Planner 把 Criteria 树转换成 PlanNode 树：And 的子条件按 (1 - 选择率) / 代价 从大到小排列，
+ *         Or 的子条件按 选择率 / 代价 从大到小排列。
+ *      3、执行时 And 的结果为空就跳过剩下的子条件，Or 已经命中全部输入也跳过剩下的子条件。
+ *      4、explain 输出选中的计划，以及每个节点估算的行数与实际的行数。
+ *
+ * 运行 `filter_planner bench [rows]` 对比按书写顺序执行与按计划执行的耗时。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Person {
+public:
+    Person(std::string name, std::string gender, std::string maritalStatus) : m_name(name),
+        m_gender(gender), m_maritalStatus(maritalStatus) {}
+
+    const std::string& getName() const {
+        return m_name;
+    }
+
+    const std::string& getGender() const {
+        return m_gender;
+    }
+
+    const std::string& getMaritalStatus() const {
+        return m_maritalStatus;
+    }
+
+private:
+    std::string m_name;
+    std::string m_gender;
+    std::string m_maritalStatus;
+};
+
+enum class Column {
+    Gender,
+    MaritalStatus
+};
+
+static const char* getColumnName(Column column) {
+    return column == Column::Gender ? "Gender" : "Marital Status";
+}
+
+static const std::string& getColumn(const Person& person, Column column) {
+    return column == Column::Gender ? person.getGender() : person.getMaritalStatus();
+}
+
+//每一列每个取值的行数
+class Statistics {
+public:
+    Statistics() : m_rows(0) {}
+
+    void analyze(const std::vector<Person>& persons) {
+        m_rows = persons.size();
+        m_counts.clear();
+
+        for (auto& person : persons) {
+            ++m_counts[std::make_pair(Column::Gender, person.getGender())];
+            ++m_counts[std::make_pair(Column::MaritalStatus, person.getMaritalStatus())];
+        }
+    }
+
+    size_t rows() const {
+        return m_rows;
+    }
+
+    double selectivity(Column column, const std::string& value) const {
+        auto it = m_counts.find(std::make_pair(column, value));
+
+        if (m_rows == 0 || it == m_counts.end()) {
+            return 0;
+        }
+
+        return (double)it->second / m_rows;
+    }
+
+private:
+    size_t m_rows;
+    std::map<std::pair<Column, std::string>, size_t> m_counts;
+};
+
+using sel_t = std::vector<size_t>;
+
+class SelectionContext {
+public:
+    SelectionContext() : m_depth(0) {}
+
+    sel_t& acquire() {
+        if (m_depth == m_buffers.size()) {
+            m_buffers.emplace_back();
+        }
+
+        sel_t& buffer = m_buffers[m_depth++];
+        buffer.clear();
+        return buffer;
+    }
+
+    void release() {
+        --m_depth;
+    }
+
+private:
+    std::deque<sel_t> m_buffers;
+    size_t m_depth;
+};
+
+//物理计划节点：记录估算的选择率、每行代价，以及执行时实际的输入、输出行数
+class PlanNode {
+public:
+    PlanNode() : m_selectivity(1), m_cost(1), m_inputRows(0), m_actualRows(0), m_executed(false) {}
+    virtual ~PlanNode() = default;
+
+    double getSelectivity() const {
+        return m_selectivity;
+    }
+
+    double getCost() const {
+        return m_cost;
+    }
+
+    void execute(const std::vector<Person>& persons, sel_t& selection, SelectionContext& context) {
+        m_executed = true;
+        m_inputRows = selection.size();
+        doExecute(persons, selection, context);
+        m_actualRows = selection.size();
+    }
+
+    virtual void reset() {
+        m_executed = false;
+        m_inputRows = 0;
+        m_actualRows = 0;
+    }
+
+    void explain(std::ostream& out, double estimatedInputRows, int depth = 0) const {
+        out << std::string(depth * 2, ' ') << describe() << "  [est rows: " <<
+            (size_t)(estimatedInputRows * m_selectivity + 0.5);
+
+        if (m_executed) {
+            out << ", actual rows: " << m_actualRows << " of " << m_inputRows << "]";
+        } else {
+            out << ", skipped]";
+        }
+
+        out << std::endl;
+        explainChildren(out, estimatedInputRows, depth + 1);
+    }
+
+protected:
+    virtual void doExecute(const std::vector<Person>& persons, sel_t& selection,
+                           SelectionContext& context) = 0;
+    virtual std::string describe() const = 0;
+    virtual void explainChildren(std::ostream&, double, int) const {}
+
+    double m_selectivity;
+    double m_cost;
+
+private:
+    size_t m_inputRows;
+    size_t m_actualRows;
+    bool m_executed;
+};
+
+class EqualsPlan: public PlanNode {
+public:
+    EqualsPlan(Column column, const std::string& value, double selectivity) : m_column(column),
+        m_value(value) {
+        m_selectivity = selectivity;
+        m_cost = 1;
+    }
+
+protected:
+    virtual void doExecute(const std::vector<Person>& persons, sel_t& selection,
+                           SelectionContext&) override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (getColumn(persons[row], m_column) == m_value) {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+
+    virtual std::string describe() const override {
+        return std::string(getColumnName(m_column)) + " = " + m_value;
+    }
+
+private:
+    Column m_column;
+    std::string m_value;
+};
+
+class CompositePlan: public PlanNode {
+public:
+    CompositePlan(std::vector<std::shared_ptr<PlanNode>> children) : m_children(children) {}
+
+    virtual void reset() override {
+        PlanNode::reset();
+
+        for (auto child : m_children) {
+            child->reset();
+        }
+    }
+
+protected:
+    std::vector<std::shared_ptr<PlanNode>> m_children;
+};
+
+class AndPlan: public CompositePlan {
+public:
+    //把过滤掉更多行、代价更低的子条件排在前面
+    AndPlan(std::vector<std::shared_ptr<PlanNode>> children, bool reorder) : CompositePlan(children) {
+        if (reorder) {
+            std::stable_sort(m_children.begin(), m_children.end(), [](const std::shared_ptr<PlanNode>& a,
+            const std::shared_ptr<PlanNode>& b) {
+                return (1 - a->getSelectivity()) * b->getCost() > (1 - b->getSelectivity()) * a->getCost();
+            });
+        }
+
+        double passed = 1;
+        m_cost = 0;
+
+        for (auto child : m_children) {
+            m_cost += passed * child->getCost();
+            passed *= child->getSelectivity();
+        }
+
+        m_selectivity = passed;
+    }
+
+protected:
+    virtual void doExecute(const std::vector<Person>& persons, sel_t& selection,
+                           SelectionContext& context) override {
+        for (auto child : m_children) {
+            if (selection.empty()) {
+                break;
+            }
+
+            child->execute(persons, selection, context);
+        }
+    }
+
+    virtual std::string describe() const override {
+        return "And";
+    }
+
+    virtual void explainChildren(std::ostream& out, double estimatedInputRows, int depth) const override {
+        for (auto child : m_children) {
+            child->explain(out, estimatedInputRows, depth);
+            estimatedInputRows *= child->getSelectivity();
+        }
+    }
+};
+
+class OrPlan: public CompositePlan {
+public:
+    //把命中更多行、代价更低的子条件排在前面，后面的子条件只需检查尚未命中的行
+    OrPlan(std::vector<std::shared_ptr<PlanNode>> children, bool reorder) : CompositePlan(children) {
+        if (reorder) {
+            std::stable_sort(m_children.begin(), m_children.end(), [](const std::shared_ptr<PlanNode>& a,
+            const std::shared_ptr<PlanNode>& b) {
+                return a->getSelectivity() * b->getCost() > b->getSelectivity() * a->getCost();
+            });
+        }
+
+        double remaining = 1;
+        m_cost = 0;
+
+        for (auto child : m_children) {
+            m_cost += remaining * child->getCost();
+            remaining *= 1 - child->getSelectivity();
+        }
+
+        m_selectivity = 1 - remaining;
+    }
+
+protected:
+    virtual void doExecute(const std::vector<Person>& persons, sel_t& selection,
+                           SelectionContext& context) override {
+        sel_t& candidates = context.acquire();
+        sel_t& part = context.acquire();
+        sel_t& merged = context.acquire();
+        candidates.swap(selection);
+
+        for (auto child : m_children) {
+            //已经命中全部输入，剩下的子条件不会再增加结果
+            if (selection.size() == candidates.size()) {
+                break;
+            }
+
+            part.clear();
+            std::set_difference(candidates.begin(), candidates.end(), selection.begin(), selection.end(),
+                                std::back_inserter(part));
+            child->execute(persons, part, context);
+            merged.clear();
+            std::merge(selection.begin(), selection.end(), part.begin(), part.end(),
+                       std::back_inserter(merged));
+            selection.swap(merged);
+        }
+
+        context.release();
+        context.release();
+        context.release();
+    }
+
+    virtual std::string describe() const override {
+        return "Or";
+    }
+
+    virtual void explainChildren(std::ostream& out, double estimatedInputRows, int depth) const override {
+        for (auto child : m_children) {
+            child->explain(out, estimatedInputRows, depth);
+            estimatedInputRows *= 1 - child->getSelectivity();
+        }
+    }
+};
+
+class NotPlan: public CompositePlan {
+public:
+    NotPlan(std::shared_ptr<PlanNode> child) : CompositePlan({child}) {
+        m_selectivity = 1 - child->getSelectivity();
+        m_cost = child->getCost();
+    }
+
+protected:
+    virtual void doExecute(const std::vector<Person>& persons, sel_t& selection,
+                           SelectionContext& context) override {
+        sel_t& matched = context.acquire();
+        matched.assign(selection.begin(), selection.end());
+        m_children[0]->execute(persons, matched, context);
+
+        size_t n = 0;
+        size_t j = 0;
+
+        for (size_t row : selection) {
+            while (j < matched.size() && matched[j] < row) {
+                ++j;
+            }
+
+            if (j == matched.size() || matched[j] != row) {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+        context.release();
+    }
+
+    virtual std::string describe() const override {
+        return "Not";
+    }
+
+    virtual void explainChildren(std::ostream& out, double estimatedInputRows, int depth) const override {
+        m_children[0]->explain(out, estimatedInputRows, depth);
+    }
+};
+
+class Planner;
+
+class Criteria {
+public:
+    virtual std::shared_ptr<PlanNode> createPlan(const Planner& planner) const = 0;
+    virtual ~Criteria() = default;
+};
+
+class Planner {
+public:
+    //reorder 为 false 时保持书写顺序，仅用于对比
+    Planner(const Statistics& statistics, bool reorder = true) : m_statistics(statistics),
+        m_reorder(reorder) {}
+
+    const Statistics& getStatistics() const {
+        return m_statistics;
+    }
+
+    bool isReorder() const {
+        return m_reorder;
+    }
+
+    std::shared_ptr<PlanNode> plan(const Criteria& criteria) const {
+        return criteria.createPlan(*this);
+    }
+
+private:
+    const Statistics& m_statistics;
+    bool m_reorder;
+};
+
+class CriteriaEquals: public Criteria {
+public:
+    CriteriaEquals(Column column, std::string value) : m_column(column), m_value(value) {}
+
+    virtual std::shared_ptr<PlanNode> createPlan(const Planner& planner) const override {
+        return std::make_shared<EqualsPlan>(m_column, m_value,
+                                            planner.getStatistics().selectivity(m_column, m_value));
+    }
+
+private:
+    Column m_column;
+    std::string m_value;
+};
+
+class CriteriaMale: public CriteriaEquals {
+public:
+    CriteriaMale() : CriteriaEquals(Column::Gender, "Male") {}
+};
+
+class CriteriaFemale: public CriteriaEquals {
+public:
+    CriteriaFemale() : CriteriaEquals(Column::Gender, "Female") {}
+};
+
+class CriteriaSingle: public CriteriaEquals {
+public:
+    CriteriaSingle() : CriteriaEquals(Column::MaritalStatus, "Single") {}
+};
+
+class AndCriteria: public Criteria {
+public:
+    AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criterias{criteria, otherCriteria} {}
+
+    AndCriteria(std::vector<std::shared_ptr<Criteria>> criterias) : m_criterias(criterias) {}
+
+    virtual std::shared_ptr<PlanNode> createPlan(const Planner& planner) const override {
+        std::vector<std::shared_ptr<PlanNode>> children;
+
+        for (auto criteria : m_criterias) {
+            children.push_back(planner.plan(*criteria));
+        }
+
+        return std::make_shared<AndPlan>(children, planner.isReorder());
+    }
+
+private:
+    std::vector<std::shared_ptr<Criteria>> m_criterias;
+};
+
+class OrCriteria: public Criteria {
+public:
+    OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criterias{criteria, otherCriteria} {}
+
+    OrCriteria(std::vector<std::shared_ptr<Criteria>> criterias) : m_criterias(criterias) {}
+
+    virtual std::shared_ptr<PlanNode> createPlan(const Planner& planner) const override {
+        std::vector<std::shared_ptr<PlanNode>> children;
+
+        for (auto criteria : m_criterias) {
+            children.push_back(planner.plan(*criteria));
+        }
+
+        return std::make_shared<OrPlan>(children, planner.isReorder());
+    }
+
+private:
+    std::vector<std::shared_ptr<Criteria>> m_criterias;
+};
+
+class NotCriteria: public Criteria {
+public:
+    NotCriteria(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    virtual std::shared_ptr<PlanNode> createPlan(const Planner& planner) const override {
+        return std::make_shared<NotPlan>(planner.plan(*m_criteria));
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+};
+
+//执行计划并返回满足条件的行下标
+static sel_t executePlan(PlanNode& plan, const std::vector<Person>& persons) {
+    SelectionContext context;
+    sel_t selection(persons.size());
+
+    for (size_t i = 0; i < selection.size(); ++i) {
+        selection[i] = i;
+    }
+
+    plan.reset();
+    plan.execute(persons, selection, context);
+    return selection;
+}
+
+void printPersons(const std::vector<Person>& persons, const sel_t& selection) {
+    for (size_t row : selection) {
+        std::cout << "Person : [ Name : " << persons[row].getName() << ", Gender : " <<
+                  persons[row].getGender() << ", Marital Status : " << persons[row].getMaritalStatus() << " ]" <<
+                  std::endl;
+    }
+}
+
+static int bench(size_t rows) {
+    std::vector<Person> persons;
+    persons.reserve(rows);
+
+    //约 4% 的人单身，一半是男性
+    for (size_t i = 0; i < rows; ++i) {
+        persons.push_back(Person("Person" + std::to_string(i), i % 2 ? "Male" : "Female",
+                                 i % 50 < 2 ? "Single" : "Married"));
+    }
+
+    Statistics statistics;
+    statistics.analyze(persons);
+
+    std::shared_ptr<Criteria> maleSingle = std::make_shared<AndCriteria>(
+            std::make_shared<CriteriaMale>(), std::make_shared<CriteriaSingle>());
+
+    std::shared_ptr<PlanNode> written = Planner(statistics, false).plan(*maleSingle);
+    std::shared_ptr<PlanNode> planned = Planner(statistics).plan(*maleSingle);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t writtenCount = executePlan(*written, persons).size();
+    auto middle = std::chrono::steady_clock::now();
+    size_t plannedCount = executePlan(*planned, persons).size();
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "written order: " << std::chrono::duration_cast<std::chrono::microseconds>
+              (middle - start).count() << " us" << std::endl;
+    written->explain(std::cout, statistics.rows());
+    std::cout << "planned order: " << std::chrono::duration_cast<std::chrono::microseconds>
+              (end - middle).count() << " us" << std::endl;
+    planned->explain(std::cout, statistics.rows());
+
+    return writtenCount == plannedCount ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 4000000);
+    }
+
+    std::vector<Person> persons;
+    persons.push_back(Person("Robert", "Male", "Single"));
+    persons.push_back(Person("John", "Male", "Married"));
+    persons.push_back(Person("Laura", "Female", "Married"));
+    persons.push_back(Person("Diana", "Female", "Single"));
+    persons.push_back(Person("Mike", "Male", "Married"));
+    persons.push_back(Person("Bobby", "Male", "Married"));
+
+    Statistics statistics;
+    statistics.analyze(persons);
+    Planner planner(statistics);
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+
+    std::shared_ptr<PlanNode> maleSingle = planner.plan(AndCriteria(male, single));
+    std::cout << "Male And Single:" << std::endl;
+    printPersons(persons, executePlan(*maleSingle, persons));
+    maleSingle->explain(std::cout, statistics.rows());
+
+    //没有离异的人，第一个子条件的结果为空，其余子条件被跳过
+    std::shared_ptr<Criteria> divorced = std::make_shared<CriteriaEquals>(Column::MaritalStatus,
+                                         "Divorced");
+    std::shared_ptr<PlanNode> maleDivorced = planner.plan(AndCriteria(male, divorced));
+    std::cout << "\nMale And Divorced:" << std::endl;
+    printPersons(persons, executePlan(*maleDivorced, persons));
+    maleDivorced->explain(std::cout, statistics.rows());
+
+    //Male 与 Female 已经覆盖全部输入，Single 被跳过
+    std::shared_ptr<PlanNode> anyone = planner.plan(OrCriteria({female, single, male}));
+    std::cout << "\nFemale Or Single Or Male:" << std::endl;
+    printPersons(persons, executePlan(*anyone, persons));
+    anyone->explain(std::cout, statistics.rows());
+
+    return 0;
+}
@@ -0,0 +1,506 @@
+/**
+ * 过滤器模式（Filter Pattern）的流式数据源
+ *
+ * filter.cpp 在执行任何 Criteria 之前，需要先把全部 Person 构造到内存中的 std::list 里，
+ * 数据文件有几十 GB 时无法这样做。这里用 mmap 按固定大小的窗口映射 CSV 文件（每行 name,gender,maritalStatus），
+ * 在映射的内存中原地切分字段，不为每条记录分配 std::string，再按固定大小的批次交给 Criteria 组合过滤。
+ * 窗口向后滑动时旧的映射会被释放，常驻内存只与窗口大小和批次大小有关，与文件大小无关。
+ *
+ * 项目使用 C++11，没有 std::string_view，这里用 StringRef（指针加长度）表示字段。
+ *
+ * 运行 `filter_stream bench [rows]` 生成测试文件并输出吞吐量与最大常驻内存。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class StringRef {
+public:
+    StringRef() : m_data(nullptr), m_size(0) {}
+    StringRef(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    std::string str() const {
+        return std::string(m_data, m_size);
+    }
+
+    bool operator==(const char* other) const {
+        return std::strlen(other) == m_size && std::memcmp(m_data, other, m_size) == 0;
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+};
+
+std::ostream& operator<<(std::ostream& out, const StringRef& ref) {
+    return out.write(ref.data(), ref.size());
+}
+
+//字段指向映射的文件内容，只在取下一批数据之前有效
+class PersonRef {
+public:
+    PersonRef(StringRef name, StringRef gender, StringRef maritalStatus) : m_name(name),
+        m_gender(gender), m_maritalStatus(maritalStatus) {}
+
+    StringRef getName() const {
+        return m_name;
+    }
+
+    StringRef getGender() const {
+        return m_gender;
+    }
+
+    StringRef getMaritalStatus() const {
+        return m_maritalStatus;
+    }
+
+private:
+    StringRef m_name;
+    StringRef m_gender;
+    StringRef m_maritalStatus;
+};
+
+using batch_t = std::vector<PersonRef>;
+
+class MappedPersonSource {
+public:
+    MappedPersonSource(const std::string& path, size_t windowSize = 64 << 20) : m_fd(-1),
+        m_fileSize(0), m_offset(0), m_map(nullptr), m_mapOffset(0), m_mapSize(0) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        m_windowSize = std::max((windowSize + pageSize - 1) / pageSize, (size_t)2) * pageSize;
+
+        m_fd = open(path.c_str(), O_RDONLY);
+
+        if (m_fd < 0) {
+            throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+
+        if (fstat(m_fd, &st) != 0) {
+            close(m_fd);
+            throw std::runtime_error("fstat " + path + ": " + std::strerror(errno));
+        }
+
+        m_fileSize = st.st_size;
+    }
+
+    ~MappedPersonSource() {
+        unmap();
+        close(m_fd);
+    }
+
+    MappedPersonSource(const MappedPersonSource&) = delete;
+    MappedPersonSource& operator=(const MappedPersonSource&) = delete;
+
+    //读取最多 maxRows 条记录，文件读完时返回 false。一批记录总是位于同一个映射窗口内
+    bool nextBatch(batch_t& batch, size_t maxRows) {
+        batch.clear();
+
+        while (batch.size() < maxRows && m_offset < m_fileSize) {
+            if (m_offset < m_mapOffset || m_offset >= m_mapOffset + m_mapSize) {
+                if (!batch.empty()) {
+                    break;
+                }
+
+                map(m_offset);
+            }
+
+            const char* begin = m_map + (m_offset - m_mapOffset);
+            const char* end = m_map + m_mapSize;
+            const char* lineEnd = (const char*)std::memchr(begin, '\n', end - begin);
+
+            if (lineEnd == nullptr) {
+                if (m_mapOffset + m_mapSize < m_fileSize) {
+                    //记录跨越了窗口的末尾，下一批从这条记录开始重新映射
+                    if (!batch.empty()) {
+                        break;
+                    }
+
+                    if (m_mapOffset == alignDown(m_offset)) {
+                        throw std::runtime_error("record larger than mapping window");
+                    }
+
+                    map(m_offset);
+                    continue;
+                }
+
+                lineEnd = end;
+            }
+
+            m_offset += lineEnd - begin + 1;
+
+            if (lineEnd > begin && lineEnd[-1] == '\r') {
+                --lineEnd;
+            }
+
+            if (lineEnd != begin) {
+                batch.push_back(parse(begin, lineEnd));
+            }
+        }
+
+        return !batch.empty();
+    }
+
+private:
+    size_t alignDown(size_t offset) const {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        return offset / pageSize * pageSize;
+    }
+
+    void map(size_t offset) {
+        unmap();
+        m_mapOffset = alignDown(offset);
+        m_mapSize = std::min(m_windowSize, m_fileSize - m_mapOffset);
+        void* map = mmap(nullptr, m_mapSize, PROT_READ, MAP_PRIVATE, m_fd, m_mapOffset);
+
+        if (map == MAP_FAILED) {
+            m_mapSize = 0;
+            throw std::runtime_error(std::string("mmap: ") + std::strerror(errno));
+        }
+
+        madvise(map, m_mapSize, MADV_SEQUENTIAL);
+        m_map = (const char*)map;
+    }
+
+    void unmap() {
+        if (m_map != nullptr) {
+            munmap((void*)m_map, m_mapSize);
+            m_map = nullptr;
+        }
+    }
+
+    static PersonRef parse(const char* begin, const char* end) {
+        const char* comma1 = (const char*)std::memchr(begin, ',', end - begin);
+        const char* comma2 = comma1 ? (const char*)std::memchr(comma1 + 1, ',', end - comma1 - 1) : nullptr;
+
+        if (comma2 == nullptr) {
+            throw std::runtime_error("malformed record: " + std::string(begin, end));
+        }
+
+        return PersonRef(StringRef(begin, comma1 - begin), StringRef(comma1 + 1, comma2 - comma1 - 1),
+                         StringRef(comma2 + 1, end - comma2 - 1));
+    }
+
+    int m_fd;
+    size_t m_fileSize;
+    size_t m_windowSize;
+    size_t m_offset;
+    const char* m_map;
+    size_t m_mapOffset;
+    size_t m_mapSize;
+};
+
+using sel_t = std::vector<size_t>;
+
+class SelectionContext {
+public:
+    SelectionContext() : m_depth(0) {}
+
+    sel_t& acquire() {
+        if (m_depth == m_buffers.size()) {
+            m_buffers.emplace_back();
+        }
+
+        sel_t& buffer = m_buffers[m_depth++];
+        buffer.clear();
+        return buffer;
+    }
+
+    void release() {
+        --m_depth;
+    }
+
+private:
+    std::deque<sel_t> m_buffers;
+    size_t m_depth;
+};
+
+class Criteria {
+public:
+    virtual void refine(const batch_t& persons, sel_t& selection, SelectionContext& context) const = 0;
+    virtual ~Criteria() = default;
+};
+
+class CriteriaMale: public Criteria {
+public:
+    virtual void refine(const batch_t& persons, sel_t& selection, SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getGender() == "Male") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class CriteriaFemale: public Criteria {
+public:
+    virtual void refine(const batch_t& persons, sel_t& selection, SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getGender() == "Female") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class CriteriaSingle: public Criteria {
+public:
+    virtual void refine(const batch_t& persons, sel_t& selection, SelectionContext&) const override {
+        size_t n = 0;
+
+        for (size_t row : selection) {
+            if (persons[row].getMaritalStatus() == "Single") {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+    }
+};
+
+class AndCriteria: public Criteria {
+public:
+    AndCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criteria(criteria), m_otherCriteria(otherCriteria) {}
+
+    virtual void refine(const batch_t& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        m_criteria->refine(persons, selection, context);
+        m_otherCriteria->refine(persons, selection, context);
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+    std::shared_ptr<Criteria> m_otherCriteria;
+};
+
+class OrCriteria: public Criteria {
+public:
+    OrCriteria(std::shared_ptr<Criteria> criteria, std::shared_ptr<Criteria> otherCriteria) :
+        m_criterias{criteria, otherCriteria} {}
+
+    OrCriteria(std::vector<std::shared_ptr<Criteria>> criterias) : m_criterias(criterias) {}
+
+    virtual void refine(const batch_t& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        sel_t& candidates = context.acquire();
+        sel_t& part = context.acquire();
+        sel_t& merged = context.acquire();
+        candidates.swap(selection);
+
+        for (auto criteria : m_criterias) {
+            part.clear();
+            std::set_difference(candidates.begin(), candidates.end(), selection.begin(), selection.end(),
+                                std::back_inserter(part));
+            criteria->refine(persons, part, context);
+            merged.clear();
+            std::merge(selection.begin(), selection.end(), part.begin(), part.end(),
+                       std::back_inserter(merged));
+            selection.swap(merged);
+        }
+
+        context.release();
+        context.release();
+        context.release();
+    }
+
+private:
+    std::vector<std::shared_ptr<Criteria>> m_criterias;
+};
+
+class NotCriteria: public Criteria {
+public:
+    NotCriteria(std::shared_ptr<Criteria> criteria) : m_criteria(criteria) {}
+
+    virtual void refine(const batch_t& persons, sel_t& selection,
+                        SelectionContext& context) const override {
+        sel_t& matched = context.acquire();
+        matched.assign(selection.begin(), selection.end());
+        m_criteria->refine(persons, matched, context);
+
+        size_t n = 0;
+        size_t j = 0;
+
+        for (size_t row : selection) {
+            while (j < matched.size() && matched[j] < row) {
+                ++j;
+            }
+
+            if (j == matched.size() || matched[j] != row) {
+                selection[n++] = row;
+            }
+        }
+
+        selection.resize(n);
+        context.release();
+    }
+
+private:
+    std::shared_ptr<Criteria> m_criteria;
+};
+
+//逐批读取数据源并过滤，sink 收到每一批数据以及其中满足条件的行下标，返回满足条件的总行数
+class StreamingFilter {
+public:
+    StreamingFilter(size_t batchRows = 4096) : m_batchRows(batchRows) {
+        m_batch.reserve(batchRows);
+        m_selection.reserve(batchRows);
+    }
+
+    size_t run(MappedPersonSource& source, const Criteria& criteria,
+               std::function<void(const batch_t&, const sel_t&)> sink) {
+        size_t matched = 0;
+
+        while (source.nextBatch(m_batch, m_batchRows)) {
+            m_selection.resize(m_batch.size());
+
+            for (size_t i = 0; i < m_selection.size(); ++i) {
+                m_selection[i] = i;
+            }
+
+            criteria.refine(m_batch, m_selection, m_context);
+            matched += m_selection.size();
+
+            if (sink) {
+                sink(m_batch, m_selection);
+            }
+        }
+
+        return matched;
+    }
+
+private:
+    size_t m_batchRows;
+    batch_t m_batch;
+    sel_t m_selection;
+    SelectionContext m_context;
+};
+
+void printPersons(const batch_t& persons, const sel_t& selection) {
+    for (size_t row : selection) {
+        std::cout << "Person : [ Name : " << persons[row].getName() << ", Gender : " <<
+                  persons[row].getGender() << ", Marital Status : " << persons[row].getMaritalStatus() << " ]" <<
+                  std::endl;
+    }
+}
+
+static std::string getTempPath(const char* name) {
+    const char* dir = std::getenv("TMPDIR");
+    return std::string(dir ? dir : "/tmp") + "/" + name + "." + std::to_string(getpid()) + ".csv";
+}
+
+static int bench(size_t rows) {
+    std::string path = getTempPath("filter_stream_bench");
+
+    {
+        std::ofstream out(path);
+
+        for (size_t i = 0; i < rows; ++i) {
+            out << "Person" << i << "," << (i % 2 ? "Male" : "Female") << "," <<
+                (i % 3 ? "Married" : "Single") << "\n";
+        }
+    }
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    AndCriteria singleMale(single, male);
+
+    //窗口只有 16MB，文件再大常驻内存也不会增长
+    MappedPersonSource source(path, 16 << 20);
+    StreamingFilter filter;
+
+    struct stat st;
+    stat(path.c_str(), &st);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t matched = filter.run(source, singleMale, nullptr);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::cout << "rows: " << rows << ", file: " << st.st_size / (1 << 20) << " MB" << std::endl;
+    std::cout << "matched: " << matched << ", " << seconds * 1000 << " ms, " <<
+              st.st_size / seconds / (1 << 20) << " MB/s" << std::endl;
+    std::cout << "max resident: " << usage.ru_maxrss / 1024 << " MB" << std::endl;
+
+    std::remove(path.c_str());
+
+    //i % 6 == 3 的行是单身男性
+    return matched == (rows + 2) / 6 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 10000000);
+    }
+
+    std::string path = getTempPath("filter_stream");
+
+    {
+        std::ofstream out(path);
+        out << "Robert,Male,Single\n";
+        out << "John,Male,Married\n";
+        out << "Laura,Female,Married\n";
+        out << "Diana,Female,Single\n";
+        out << "Mike,Male,Single\n";
+        out << "Bobby,Male,Single\n";
+    }
+
+    std::shared_ptr<Criteria> male = std::make_shared<CriteriaMale>();
+    std::shared_ptr<Criteria> female = std::make_shared<CriteriaFemale>();
+    std::shared_ptr<Criteria> single = std::make_shared<CriteriaSingle>();
+    std::shared_ptr<Criteria> singleMale = std::make_shared<AndCriteria>(single, male);
+    std::shared_ptr<Criteria> singleOrFemale = std::make_shared<OrCriteria>(single, female);
+
+    //演示时每批只取两行
+    StreamingFilter filter(2);
+
+    std::cout << "Single Male:" << std::endl;
+    MappedPersonSource source(path);
+    filter.run(source, *singleMale, printPersons);
+
+    std::cout << "\nSingle Or Female:" << std::endl;
+    MappedPersonSource otherSource(path);
+    filter.run(otherSource, *singleOrFemale, printPersons);
+
+    std::remove(path.c_str());
+    return 0;
+}
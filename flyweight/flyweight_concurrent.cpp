@@ -0,0 +1,433 @@
+/**
+ * 享元模式（Flyweight Pattern）的并发享元池
+ *
+ * flyweight.cpp 中 ShapeFactory::getCircle 用 std::map 保存享元，没有任何同步，多个线程同时调用会破坏 map；
+ * 而且 m_circleMap[color] 在没有找到时会插入一个空的 shared_ptr；每次调用还要按值构造一个 std::string。
+ *
+ * 这里的 FlyweightPool 是一个分片的开放寻址哈希表：
+ *      1、按键的哈希选择分片，每个分片是一个线性探测的表，槽里保存指向不可变 Entry 的原子指针。
+ *      2、读：加载表指针和槽都是 acquire 读，命中时不加锁、不写任何共享内存，返回 Entry 中 shared_ptr 的引用，
+ *         多个线程读同一个享元也不会争用引用计数。
+ *      3、未命中：加分片的锁再查一次，仍然没有才创建，同一个键在竞争下只创建一次；
+ *         填好 Entry 之后用 release 写入空槽发布。
+ *      4、装载因子超过 1/2 时在锁内把 Entry 放进两倍大小的新表，再发布新表。旧表可能还有线程在读，
+ *         保留到池销毁（总大小不超过最终表的两倍）；享元本身从不删除。
+ * 查找参数是 StringRef（指针加长度，相当于 C++17 的 std::string_view），
+ * 用 const char* 或 std::string 调用都不会构造新的字符串，只有第一次创建时才复制键。
+ *
+ * 运行 `flyweight_concurrent bench [lookups] [keys]` 在 1~8 个线程下与加锁的 std::map 对比，
+ * 并检查每个键只创建了一次、所有线程拿到的是同一个对象。
+*/
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Shape {
+public:
+    virtual void draw() = 0;
+    virtual ~Shape() = default;
+};
+
+class Circle: public Shape {
+public:
+    Circle(std::string color) {
+        m_color = color;
+    }
+
+    void setX(int x) {
+        m_x = x;
+    }
+
+    void setY(int y) {
+        m_y = y;
+    }
+
+    void setRadius(int radius) {
+        m_radius = radius;
+    }
+
+    virtual void draw() override {
+        std::cout << "Circle: Draw() [Color : " << m_color << ", x : " << m_x << ", y :" << m_y <<
+                  ", radius :" << m_radius << std::endl;
+    }
+
+private:
+    std::string m_color;
+
+    int m_x;
+    int m_y;
+    int m_radius;
+};
+
+//不拥有内存的字符串引用
+class StringRef {
+public:
+    StringRef(const char* data) : m_data(data), m_size(std::strlen(data)) {}
+
+    StringRef(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    StringRef(const std::string& str) : m_data(str.data()), m_size(str.size()) {}
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    std::string str() const {
+        return std::string(m_data, m_size);
+    }
+
+    bool operator==(const std::string& other) const {
+        return m_size == other.size() && std::memcmp(m_data, other.data(), m_size) == 0;
+    }
+
+    //FNV-1a
+    uint64_t hash() const {
+        uint64_t h = 0xcbf29ce484222325ULL;
+
+        for (size_t i = 0; i < m_size; ++i) {
+            h = (h ^ (unsigned char)m_data[i]) * 0x100000001b3ULL;
+        }
+
+        return h ^ (h >> 29);
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+};
+
+template<typename T>
+class FlyweightPool {
+public:
+    //shards 向上取整为 2 的幂
+    FlyweightPool(size_t shards = 16) : m_shardMask(1) {
+        while (m_shardMask < shards) {
+            m_shardMask *= 2;
+        }
+
+        m_shards.reset(new Shard[m_shardMask]);
+        --m_shardMask;
+    }
+
+    FlyweightPool(const FlyweightPool&) = delete;
+    FlyweightPool& operator=(const FlyweightPool&) = delete;
+
+    //已有时无锁返回；没有时调用 create(key) 创建，每个键只创建一次。返回的引用在池销毁前一直有效
+    template<typename Create>
+    const std::shared_ptr<T>& get(StringRef key, Create create) {
+        uint64_t hash = key.hash();
+        Shard& shard = m_shards[(hash >> 32) & m_shardMask];
+        Entry* entry = find(shard.table.load(std::memory_order_acquire), key, hash);
+
+        if (entry != nullptr) {
+            return entry->value;
+        }
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        entry = find(table, key, hash);
+
+        if (entry != nullptr) {
+            return entry->value;
+        }
+
+        std::string name = key.str();
+        std::unique_ptr<Entry> created(new Entry(name, hash, create(name)));
+
+        if ((shard.entries.size() + 1) * 2 > table->mask + 1) {
+            table = grow(shard);
+        }
+
+        insert(table, created.get());
+        shard.entries.push_back(std::move(created));
+        return shard.entries.back()->value;
+    }
+
+    size_t size() const {
+        size_t count = 0;
+
+        for (size_t i = 0; i <= m_shardMask; ++i) {
+            std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+            count += m_shards[i].entries.size();
+        }
+
+        return count;
+    }
+
+private:
+    struct Entry {
+        Entry(const std::string& key, uint64_t hash, std::shared_ptr<T> value) : key(key), hash(hash), value(value) {}
+
+        const std::string key;
+        const uint64_t hash;
+        const std::shared_ptr<T> value;
+    };
+
+    struct Table {
+        Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Entry*>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+    };
+
+    struct Shard {
+        Shard() : table(new Table(16)) {
+            tables.push_back(std::unique_ptr<Table>(table.load()));
+        }
+
+        std::atomic<Table*> table;
+        mutable std::mutex mutex;
+        //以下只在锁内修改
+        std::vector<std::unique_ptr<Entry>> entries;
+        //当前表和所有旧表
+        std::vector<std::unique_ptr<Table>> tables;
+    };
+
+    //装载因子不超过 1/2，总能遇到空槽
+    static Entry* find(const Table* table, StringRef key, uint64_t hash) {
+        for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            Entry* entry = table->slots[i].load(std::memory_order_acquire);
+
+            if (entry == nullptr) {
+                return nullptr;
+            }
+
+            if (entry->hash == hash && key == entry->key) {
+                return entry;
+            }
+        }
+    }
+
+    static void insert(Table* table, Entry* entry) {
+        size_t i = entry->hash & table->mask;
+
+        while (table->slots[i].load(std::memory_order_relaxed) != nullptr) {
+            i = (i + 1) & table->mask;
+        }
+
+        table->slots[i].store(entry, std::memory_order_release);
+    }
+
+    static Table* grow(Shard& shard) {
+        Table* table = new Table(2 * (shard.table.load(std::memory_order_relaxed)->mask + 1));
+        shard.tables.push_back(std::unique_ptr<Table>(table));
+
+        for (auto& entry : shard.entries) {
+            insert(table, entry.get());
+        }
+
+        shard.table.store(table, std::memory_order_release);
+        return table;
+    }
+
+    size_t m_shardMask;
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+class ShapeFactory {
+public:
+    //log 为空时创建享元不输出
+    ShapeFactory(std::ostream* log = &std::cout) : m_log(log), m_created(0) {}
+
+    const std::shared_ptr<Shape>& getCircle(StringRef color) {
+        return m_circles.get(color, [this](const std::string& key) {
+            ++m_created;
+
+            if (m_log != nullptr) {
+                std::lock_guard<std::mutex> lock(m_logMutex);
+                *m_log << "=================Creating circle of color : " << key << std::endl;
+            }
+
+            return std::make_shared<Circle>(key);
+        });
+    }
+
+    size_t getCreatedCount() const {
+        return m_created;
+    }
+
+private:
+    FlyweightPool<Shape> m_circles;
+    std::ostream* m_log;
+    //不同分片可能同时创建
+    std::mutex m_logMutex;
+    std::atomic<size_t> m_created;
+};
+
+//对照：flyweight.cpp 的 ShapeFactory 加一把锁，并用 find 代替 operator[]
+class LockedShapeFactory {
+public:
+    LockedShapeFactory() : m_created(0) {}
+
+    std::shared_ptr<Shape> getCircle(std::string color) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_circleMap.find(color);
+
+        if (it != m_circleMap.end()) {
+            return it->second;
+        }
+
+        ++m_created;
+        std::shared_ptr<Shape> circle = std::make_shared<Circle>(color);
+        m_circleMap.insert(std::make_pair(color, circle));
+        return circle;
+    }
+
+    size_t getCreatedCount() const {
+        return m_created;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Shape>> m_circleMap;
+    size_t m_created;
+};
+
+//每个线程按自己的随机序列查找，检查同一个键总是得到同一个对象
+template<typename Factory>
+static bool runLookups(Factory& factory, const std::vector<std::string>& keys, int threads, size_t lookups,
+                       double& ms) {
+    std::vector<std::vector<Shape*>> seen(threads, std::vector<Shape*>(keys.size(), nullptr));
+    std::atomic<bool> consistent(true);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t] {
+            std::default_random_engine engine(t + 1);
+            std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+            std::vector<Shape*>& mine = seen[t];
+
+            for (size_t i = 0; i < lookups / threads; ++i) {
+                size_t k = pick(engine);
+                Shape* shape = factory.getCircle(keys[k].c_str()).get();
+
+                if (mine[k] == nullptr) {
+                    mine[k] = shape;
+                } else if (mine[k] != shape) {
+                    consistent = false;
+                }
+            }
+        }));
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    size_t distinct = 0;
+
+    for (size_t k = 0; k < keys.size(); ++k) {
+        Shape* first = nullptr;
+
+        for (int t = 0; t < threads; ++t) {
+            if (first == nullptr) {
+                first = seen[t][k];
+            } else if (seen[t][k] != nullptr && seen[t][k] != first) {
+                consistent = false;
+            }
+        }
+
+        distinct += first != nullptr;
+    }
+
+    return consistent && factory.getCreatedCount() == distinct;
+}
+
+static int bench(size_t lookups, size_t keyCount) {
+    std::vector<std::string> keys;
+
+    for (size_t i = 0; i < keyCount; ++i) {
+        keys.push_back("Color" + std::to_string(i));
+    }
+
+    bool ok = true;
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        ShapeFactory pooled(nullptr);
+        LockedShapeFactory locked;
+        double pooledMs = 0;
+        double lockedMs = 0;
+
+        ok = runLookups(pooled, keys, threads, lookups, pooledMs) && ok;
+        ok = runLookups(locked, keys, threads, lookups, lockedMs) && ok;
+
+        std::cout << threads << " threads: FlyweightPool " << lookups / pooledMs / 1000 << " M/s (" <<
+                  pooled.getCreatedCount() << " created), locked std::map " << lookups / lockedMs / 1000 << " M/s (" <<
+                  locked.getCreatedCount() << " created)" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
+
+std::string colors[] = {"Red", "Green", "Blue", "White", "Black"};
+std::default_random_engine e;
+
+static const char* getRandomColor() {
+    std::uniform_int_distribution<unsigned> u(0, 4); //随机数分布对象
+    return colors[(int)u(e)].c_str();
+}
+
+static int getRandomX() {
+    std::uniform_real_distribution<double> u(0, 1); //随机数分布对象
+    return (int)(u(e) * 100);
+}
+
+static int getRandomY() {
+    std::uniform_real_distribution<double> u(0, 1); //随机数分布对象
+    return (int)(u(e) * 100);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 10000000, argc > 3 ? std::stoul(argv[3]) : 1000);
+    }
+
+    std::shared_ptr<ShapeFactory> factory = std::make_shared<ShapeFactory>();
+
+    //多个线程同时取同一组颜色，每种颜色只创建一次
+    std::vector<std::thread> renderers;
+
+    for (int t = 0; t < 4; ++t) {
+        renderers.push_back(std::thread([factory] {
+            for (auto& color : colors) {
+                factory->getCircle(color);
+            }
+        }));
+    }
+
+    for (auto& renderer : renderers) {
+        renderer.join();
+    }
+
+    for (int i = 0; i < 20; ++i) {
+        std::shared_ptr<Circle> circle = std::dynamic_pointer_cast<Circle>(factory->getCircle(
+                                             getRandomColor()));
+        circle->setX(getRandomX());
+        circle->setY(getRandomY());
+        circle->setRadius(100);
+        circle->draw();
+    }
+
+    return 0;
+}
@@ -0,0 +1,421 @@
+/**
+ * 解释器模式（Interpreter Pattern）的多模式匹配
+ *
+ * interpreter.cpp 中每个 TerminalExpression 都要单独调用一次 context.find(m_data)，
+ * 规则里有几千个关键字时，同一个上下文会被扫描几千遍。
+ *
+ * 这里增加一个编译步骤：
+ *      1、收集一组 Expression 中所有的终结符，相同的关键字只保留一份，构造 Aho–Corasick 自动机。
+ *      2、每个上下文只扫描一遍，得到一个记录哪些关键字出现过的位图（MatchSet）。
+ *      3、再在位图上计算每条规则的与/或结构，不再访问上下文字符串。
+ *
+ * 自动机做了字母表压缩：只有在关键字中出现过的字节各占一个字符类，其余字节共用一个字符类，
+ * 转移表是 状态数 x 字符类数 的稠密数组，扫描时每个字节只查一次表。
+ *
+ * 运行 `interpreter_aho_corasick bench [rules]` 与逐个 find 的实现做性能对比。
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//记录哪些关键字在上下文中出现过
+class MatchSet {
+public:
+    void reset(size_t size) {
+        m_words.assign((size + 63) / 64, 0);
+    }
+
+    void set(size_t id) {
+        m_words[id / 64] |= uint64_t(1) << (id % 64);
+    }
+
+    bool test(size_t id) const {
+        return (m_words[id / 64] >> (id % 64)) & 1;
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+};
+
+class AhoCorasick {
+public:
+    AhoCorasick() : m_classes(0) {}
+
+    //返回关键字的编号，相同的关键字返回相同的编号
+    size_t addPattern(const std::string& pattern) {
+        auto it = m_patternIds.find(pattern);
+
+        if (it != m_patternIds.end()) {
+            return it->second;
+        }
+
+        size_t id = m_patterns.size();
+        m_patternIds[pattern] = id;
+        m_patterns.push_back(pattern);
+        return id;
+    }
+
+    size_t size() const {
+        return m_patterns.size();
+    }
+
+    void build() {
+        std::memset(m_byteClass, 0, sizeof(m_byteClass));
+        m_classes = 1;
+
+        for (auto& pattern : m_patterns) {
+            for (unsigned char c : pattern) {
+                if (m_byteClass[c] == 0) {
+                    m_byteClass[c] = m_classes++;
+                }
+            }
+        }
+
+        //先构造字典树，转移为 -1 表示没有边
+        m_next.assign(m_classes, -1);
+        m_fail.assign(1, 0);
+        m_output.assign(1, -1);
+        m_outputLink.assign(1, -1);
+        m_emptyPatterns.clear();
+
+        for (size_t id = 0; id < m_patterns.size(); ++id) {
+            if (m_patterns[id].empty()) {
+                m_emptyPatterns.push_back(id);
+                continue;
+            }
+
+            int32_t state = 0;
+
+            for (unsigned char c : m_patterns[id]) {
+                int32_t& next = m_next[state * m_classes + m_byteClass[c]];
+
+                if (next < 0) {
+                    next = (int32_t)m_fail.size();
+                    m_next.resize(m_next.size() + m_classes, -1);
+                    m_fail.push_back(0);
+                    m_output.push_back(-1);
+                    m_outputLink.push_back(-1);
+                }
+
+                state = m_next[state * m_classes + m_byteClass[c]];
+            }
+
+            m_output[state] = (int32_t)id;
+        }
+
+        //按广度优先计算失败指针，并把缺失的边补全成完整的 DFA
+        std::queue<int32_t> queue;
+
+        for (size_t c = 0; c < m_classes; ++c) {
+            int32_t& next = m_next[c];
+
+            if (next < 0) {
+                next = 0;
+            } else {
+                m_fail[next] = 0;
+                queue.push(next);
+            }
+        }
+
+        while (!queue.empty()) {
+            int32_t state = queue.front();
+            queue.pop();
+            int32_t fail = m_fail[state];
+            m_outputLink[state] = m_output[fail] >= 0 ? fail : m_outputLink[fail];
+
+            for (size_t c = 0; c < m_classes; ++c) {
+                int32_t& next = m_next[state * m_classes + c];
+
+                if (next < 0) {
+                    next = m_next[fail * m_classes + c];
+                } else {
+                    m_fail[next] = m_next[fail * m_classes + c];
+                    queue.push(next);
+                }
+            }
+        }
+    }
+
+    //扫描一遍上下文，把出现过的关键字记录到 matched
+    void scan(const char* data, size_t size, MatchSet& matched) const {
+        matched.reset(m_patterns.size());
+
+        for (size_t id : m_emptyPatterns) {
+            matched.set(id);
+        }
+
+        int32_t state = 0;
+
+        for (size_t i = 0; i < size; ++i) {
+            state = m_next[state * m_classes + m_byteClass[(unsigned char)data[i]]];
+
+            for (int32_t s = m_output[state] >= 0 ? state : m_outputLink[state]; s > 0; s = m_outputLink[s]) {
+                matched.set(m_output[s]);
+            }
+        }
+    }
+
+private:
+    std::vector<std::string> m_patterns;
+    std::unordered_map<std::string, size_t> m_patternIds;
+    std::vector<size_t> m_emptyPatterns;
+
+    //0 是不出现在任何模式中的字节，最多 257 类，所以用 uint16_t
+    uint16_t m_byteClass[256];
+    size_t m_classes;
+    std::vector<int32_t> m_next;
+    std::vector<int32_t> m_fail;
+    std::vector<int32_t> m_output;
+    std::vector<int32_t> m_outputLink;
+};
+
+//编译后的规则，在 MatchSet 上计算与/或结构
+class CompiledExpression {
+public:
+    virtual bool evaluate(const MatchSet& matched) const = 0;
+    virtual ~CompiledExpression() = default;
+};
+
+class CompiledTerminal: public CompiledExpression {
+public:
+    CompiledTerminal(size_t id) : m_id(id) {}
+
+    virtual bool evaluate(const MatchSet& matched) const override {
+        return matched.test(m_id);
+    }
+
+private:
+    size_t m_id;
+};
+
+class CompiledOr: public CompiledExpression {
+public:
+    CompiledOr(std::shared_ptr<CompiledExpression> expr1,
+               std::shared_ptr<CompiledExpression> expr2) : m_expr1(expr1), m_expr2(expr2) {}
+
+    virtual bool evaluate(const MatchSet& matched) const override {
+        return m_expr1->evaluate(matched) || m_expr2->evaluate(matched);
+    }
+
+private:
+    std::shared_ptr<CompiledExpression> m_expr1;
+    std::shared_ptr<CompiledExpression> m_expr2;
+};
+
+class CompiledAnd: public CompiledExpression {
+public:
+    CompiledAnd(std::shared_ptr<CompiledExpression> expr1,
+                std::shared_ptr<CompiledExpression> expr2) : m_expr1(expr1), m_expr2(expr2) {}
+
+    virtual bool evaluate(const MatchSet& matched) const override {
+        return m_expr1->evaluate(matched) && m_expr2->evaluate(matched);
+    }
+
+private:
+    std::shared_ptr<CompiledExpression> m_expr1;
+    std::shared_ptr<CompiledExpression> m_expr2;
+};
+
+class Expression {
+public:
+    virtual bool interpret(std::string context) = 0;
+    //把终结符登记到自动机中，返回在 MatchSet 上求值的等价规则
+    virtual std::shared_ptr<CompiledExpression> compile(AhoCorasick& automaton) const = 0;
+    virtual ~Expression() = default;
+};
+
+class TerminalExpression: public Expression {
+public:
+    TerminalExpression(std::string data) : m_data(data) {}
+
+    virtual bool interpret(std::string context) override {
+        if (context.find(m_data) != std::string::npos) {
+            return true;
+        }
+
+        return false;
+    }
+
+    virtual std::shared_ptr<CompiledExpression> compile(AhoCorasick& automaton) const override {
+        return std::make_shared<CompiledTerminal>(automaton.addPattern(m_data));
+    }
+
+private:
+    std::string m_data;
+};
+
+class OrExpression: public Expression {
+public:
+    OrExpression(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) : m_expr1(expr1),
+        m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) || m_expr2->interpret(context);
+    }
+
+    virtual std::shared_ptr<CompiledExpression> compile(AhoCorasick& automaton) const override {
+        return std::make_shared<CompiledOr>(m_expr1->compile(automaton), m_expr2->compile(automaton));
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+class AndExpression: public Expression {
+public:
+    AndExpression(std::shared_ptr<Expression> expr1,
+                  std::shared_ptr<Expression> expr2) : m_expr1(expr1), m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) && m_expr2->interpret(context);
+    }
+
+    virtual std::shared_ptr<CompiledExpression> compile(AhoCorasick& automaton) const override {
+        return std::make_shared<CompiledAnd>(m_expr1->compile(automaton), m_expr2->compile(automaton));
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+//一组规则共用一个自动机，每个上下文只扫描一遍
+class RuleSet {
+public:
+    RuleSet(const std::vector<std::shared_ptr<Expression>>& rules) {
+        for (auto rule : rules) {
+            m_rules.push_back(rule->compile(m_automaton));
+        }
+
+        m_automaton.build();
+    }
+
+    size_t getTerminalCount() const {
+        return m_automaton.size();
+    }
+
+    //results[i] 为第 i 条规则的结果
+    void interpret(const std::string& context, std::vector<bool>& results) {
+        m_automaton.scan(context.data(), context.size(), m_matched);
+        results.resize(m_rules.size());
+
+        for (size_t i = 0; i < m_rules.size(); ++i) {
+            results[i] = m_rules[i]->evaluate(m_matched);
+        }
+    }
+
+private:
+    AhoCorasick m_automaton;
+    std::vector<std::shared_ptr<CompiledExpression>> m_rules;
+    MatchSet m_matched;
+};
+
+//规则：Robert 和 John 是男性
+static std::shared_ptr<Expression> getMaleExpression() {
+    std::shared_ptr<Expression> robert = std::make_shared<TerminalExpression>("Robert");
+    std::shared_ptr<Expression> john = std::make_shared<TerminalExpression>("John");
+    return std::make_shared<OrExpression>(robert, john);
+}
+
+//规则：Julie 是一个已婚的女性
+static std::shared_ptr<Expression> getMarriedWomanExpression() {
+    std::shared_ptr<Expression> julie = std::make_shared<TerminalExpression>("Julie");
+    std::shared_ptr<Expression> married = std::make_shared<TerminalExpression>("Married");
+    return std::make_shared<AndExpression>(julie, married);
+}
+
+static int bench(size_t ruleCount) {
+    std::default_random_engine engine;
+    std::uniform_int_distribution<size_t> keyword(0, ruleCount * 2);
+    auto word = [](size_t i) {
+        return "kw" + std::to_string(i) + "x";
+    };
+
+    //每条规则形如 a | (b & c)
+    std::vector<std::shared_ptr<Expression>> rules;
+
+    for (size_t i = 0; i < ruleCount; ++i) {
+        rules.push_back(std::make_shared<OrExpression>(
+                            std::make_shared<TerminalExpression>(word(keyword(engine))),
+                            std::make_shared<AndExpression>(std::make_shared<TerminalExpression>(word(keyword(engine))),
+                                    std::make_shared<TerminalExpression>(word(keyword(engine))))));
+    }
+
+    std::vector<std::string> contexts;
+
+    for (int i = 0; i < 200; ++i) {
+        std::string context;
+
+        for (int j = 0; j < 40; ++j) {
+            context += word(keyword(engine)) + " ";
+        }
+
+        contexts.push_back(context);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RuleSet ruleSet(rules);
+    auto built = std::chrono::steady_clock::now();
+
+    size_t virtualMatches = 0;
+
+    for (auto& context : contexts) {
+        for (auto rule : rules) {
+            virtualMatches += rule->interpret(context);
+        }
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+    size_t compiledMatches = 0;
+    std::vector<bool> results;
+
+    for (auto& context : contexts) {
+        ruleSet.interpret(context, results);
+
+        for (bool result : results) {
+            compiledMatches += result;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "rules: " << ruleCount << ", terminals: " << ruleSet.getTerminalCount() <<
+              ", contexts: " << contexts.size() << std::endl;
+    std::cout << "build automaton: " << std::chrono::duration<double, std::milli>(built - start).count() <<
+              " ms" << std::endl;
+    std::cout << "find per terminal: " << virtualMatches << " matches, " <<
+              std::chrono::duration<double, std::milli>(middle - built).count() << " ms" << std::endl;
+    std::cout << "aho-corasick: " << compiledMatches << " matches, " <<
+              std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+
+    return virtualMatches == compiledMatches ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 5000);
+    }
+
+    std::shared_ptr<Expression> isMale = getMaleExpression();
+    std::shared_ptr<Expression> isMarriedWoman = getMarriedWomanExpression();
+
+    RuleSet ruleSet({isMale, isMarriedWoman});
+    std::vector<bool> results;
+
+    ruleSet.interpret("John", results);
+    std::cout << "John is male? " << results[0] << std::endl;
+
+    ruleSet.interpret("Married Julie", results);
+    std::cout << "Julie is a married women? " << results[1] << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/**
+ * 解释器模式（Interpreter Pattern）的批量求值
+ *
+ * Expression::interpret(std::string) 每次只处理一个上下文，并且按值复制字符串。
+ * 日志分类这类任务需要把几亿行文本交给同一组规则判断，这里增加批量接口：
+ *      1、ContextBatch 把所有上下文连续存放在一块字节区中，用偏移量数组切分，不为每行分配 std::string。
+ *      2、interpretBatch 把上下文按块分给多个线程，结果写到位图中，每一位对应一个上下文。
+ *         每块的上下文数量是 64 的倍数，不同线程不会写同一个 64 位字。
+ *      3、TerminalExpression 的子串查找用 SSE2 做预过滤：把关键字的首字节和尾字节广播到 16 字节寄存器，
+ *         一次比较 16 个候选位置，只有首尾字节都相等的位置才用 memcmp 比较中间部分。
+ *         不支持 SSE2 的平台退回到 memmem。
+ *
+ * 运行 `interpreter_batch bench [lines]` 输出逐行解释、单线程批量与多线程批量的吞吐量。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//在 data 中查找 pattern
+static bool containsSubstring(const char* data, size_t size, const char* pattern, size_t length) {
+    if (length == 0) {
+        return true;
+    }
+
+    if (length > size) {
+        return false;
+    }
+
+    if (length == 1) {
+        return std::memchr(data, pattern[0], size) != nullptr;
+    }
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[length - 1]);
+
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(data + i + length - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                          _mm_cmpeq_epi8(last, blockLast)));
+
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+
+            if (std::memcmp(data + i + bit + 1, pattern + 1, length - 2) == 0) {
+                return true;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return memmem(data + i, size - i, pattern, length) != nullptr;
+}
+
+//所有上下文连续存放在 arena 中，第 i 个上下文为 [offsets[i], offsets[i + 1])
+class ContextBatch {
+public:
+    ContextBatch() : m_offsets(1, 0) {}
+
+    void add(const char* data, size_t size) {
+        m_arena.insert(m_arena.end(), data, data + size);
+        m_offsets.push_back(m_arena.size());
+    }
+
+    void add(const std::string& context) {
+        add(context.data(), context.size());
+    }
+
+    size_t size() const {
+        return m_offsets.size() - 1;
+    }
+
+    const char* data(size_t i) const {
+        return m_arena.data() + m_offsets[i];
+    }
+
+    size_t length(size_t i) const {
+        return m_offsets[i + 1] - m_offsets[i];
+    }
+
+    size_t bytes() const {
+        return m_arena.size();
+    }
+
+private:
+    std::vector<char> m_arena;
+    std::vector<size_t> m_offsets;
+};
+
+class Expression {
+public:
+    virtual bool interpret(std::string context) = 0;
+    //不复制上下文的求值，interpretBatch 会在多个线程中同时调用
+    virtual bool match(const char* context, size_t size) const = 0;
+    virtual ~Expression() = default;
+
+    //results 的第 i 位为第 i 个上下文的结果，threads 为 0 时使用全部核心
+    void interpretBatch(const ContextBatch& contexts, std::vector<uint64_t>& results,
+                        size_t threads = 0) const {
+        const size_t chunk = 64 * 64;
+        size_t chunks = (contexts.size() + chunk - 1) / chunk;
+        results.assign((contexts.size() + 63) / 64, 0);
+
+        if (threads == 0) {
+            threads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        }
+
+        threads = std::max<size_t>(std::min(threads, chunks), 1);
+        std::atomic<size_t> nextChunk(0);
+
+        auto worker = [&]() {
+            for (size_t c = nextChunk++; c < chunks; c = nextChunk++) {
+                size_t end = std::min((c + 1) * chunk, contexts.size());
+
+                for (size_t i = c * chunk; i < end; ++i) {
+                    if (match(contexts.data(i), contexts.length(i))) {
+                        results[i / 64] |= uint64_t(1) << (i % 64);
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+
+        for (size_t t = 1; t < threads; ++t) {
+            pool.push_back(std::thread(worker));
+        }
+
+        worker();
+
+        for (auto& thread : pool) {
+            thread.join();
+        }
+    }
+};
+
+class TerminalExpression: public Expression {
+public:
+    TerminalExpression(std::string data) : m_data(data) {}
+
+    virtual bool interpret(std::string context) override {
+        if (context.find(m_data) != std::string::npos) {
+            return true;
+        }
+
+        return false;
+    }
+
+    virtual bool match(const char* context, size_t size) const override {
+        return containsSubstring(context, size, m_data.data(), m_data.size());
+    }
+
+private:
+    std::string m_data;
+};
+
+class OrExpression: public Expression {
+public:
+    OrExpression(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) : m_expr1(expr1),
+        m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) || m_expr2->interpret(context);
+    }
+
+    virtual bool match(const char* context, size_t size) const override {
+        return m_expr1->match(context, size) || m_expr2->match(context, size);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+class AndExpression: public Expression {
+public:
+    AndExpression(std::shared_ptr<Expression> expr1,
+                  std::shared_ptr<Expression> expr2) : m_expr1(expr1), m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) && m_expr2->interpret(context);
+    }
+
+    virtual bool match(const char* context, size_t size) const override {
+        return m_expr1->match(context, size) && m_expr2->match(context, size);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+//规则：Robert 和 John 是男性
+static std::shared_ptr<Expression> getMaleExpression() {
+    std::shared_ptr<Expression> robert = std::make_shared<TerminalExpression>("Robert");
+    std::shared_ptr<Expression> john = std::make_shared<TerminalExpression>("John");
+    return std::make_shared<OrExpression>(robert, john);
+}
+
+//规则：Julie 是一个已婚的女性
+static std::shared_ptr<Expression> getMarriedWomanExpression() {
+    std::shared_ptr<Expression> julie = std::make_shared<TerminalExpression>("Julie");
+    std::shared_ptr<Expression> married = std::make_shared<TerminalExpression>("Married");
+    return std::make_shared<AndExpression>(julie, married);
+}
+
+static size_t countBits(const std::vector<uint64_t>& results) {
+    size_t count = 0;
+
+    for (auto word : results) {
+        count += __builtin_popcountll(word);
+    }
+
+    return count;
+}
+
+static int bench(size_t lines) {
+    const char* names[] = {"Robert", "John", "Julie", "Laura", "Diana", "Mike", "Bobby"};
+    const char* statuses[] = {"Single", "Married", "Divorced"};
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> name(0, 6);
+    std::uniform_int_distribution<int> status(0, 2);
+
+    ContextBatch contexts;
+    std::vector<std::string> strings;
+
+    for (size_t i = 0; i < lines; ++i) {
+        std::string line = "2024-01-01 12:00:00 INFO request " + std::to_string(i) + " user=" +
+                           names[name(engine)] + " status=" + statuses[status(engine)] + " ok";
+        contexts.add(line);
+        strings.push_back(line);
+    }
+
+    std::shared_ptr<Expression> rule = std::make_shared<OrExpression>(getMaleExpression(),
+                                       getMarriedWomanExpression());
+
+    size_t expected = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& line : strings) {
+        expected += rule->interpret(line);
+    }
+
+    double legacyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double mb = contexts.bytes() / double(1 << 20);
+
+    std::cout << "lines: " << lines << ", " << mb << " MB" << std::endl;
+    std::cout << "mode\tthreads\tms\tMB/s" << std::endl;
+    std::cout << "interpret\t1\t" << legacyMs << "\t" << mb / legacyMs * 1000 << std::endl;
+
+    size_t maxThreads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    std::vector<uint64_t> results;
+
+    for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        start = std::chrono::steady_clock::now();
+        rule->interpretBatch(contexts, results, threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "batch\t" << threads << "\t" << ms << "\t" << mb / ms * 1000 << std::endl;
+
+        if (countBits(results) != expected) {
+            std::cout << "result mismatch" << std::endl;
+            return 1;
+        }
+
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    //单独对比子串查找本身
+    size_t simdHits = 0;
+    size_t memmemHits = 0;
+    start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        simdHits += containsSubstring(contexts.data(i), contexts.length(i), "Married", 7);
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        memmemHits += memmem(contexts.data(i), contexts.length(i), "Married", 7) != nullptr;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "find \"Married\": prefilter " << std::chrono::duration<double, std::milli>
+              (middle - start).count() << " ms, memmem " << std::chrono::duration<double, std::milli>
+              (end - middle).count() << " ms" << std::endl;
+
+    return simdHits == memmemHits ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 2000000);
+    }
+
+    std::shared_ptr<Expression> isMale = getMaleExpression();
+    std::shared_ptr<Expression> isMarriedWoman = getMarriedWomanExpression();
+
+    ContextBatch contexts;
+    contexts.add("John");
+    contexts.add("Married Julie");
+    contexts.add("Julie");
+
+    std::vector<uint64_t> maleResults;
+    std::vector<uint64_t> marriedWomanResults;
+    isMale->interpretBatch(contexts, maleResults);
+    isMarriedWoman->interpretBatch(contexts, marriedWomanResults);
+
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        std::string context(contexts.data(i), contexts.length(i));
+        std::cout << context << ": male? " << ((maleResults[i / 64] >> (i % 64)) & 1) <<
+                  ", married women? " << ((marriedWomanResults[i / 64] >> (i % 64)) & 1) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+/**
+ * 解释器模式（Interpreter Pattern）编译成字节码
+ *
+ * OrExpression/AndExpression 求值时通过 std::shared_ptr 虚函数递归访问子表达式，
+ * 并且 interpret(std::string context) 按值传参，每经过一个节点就复制一次上下文字符串。
+ *
+ * 这里把表达式树编译成一段扁平的字节码：
+ *      MATCH i          acc = 上下文中是否包含第 i 个关键字
+ *      JUMP_IF_TRUE t   acc 为真时跳到 t（用于 Or 的短路）
+ *      JUMP_IF_FALSE t  acc 为假时跳到 t（用于 And 的短路）
+ * 只需要一个累加器，不需要栈。编译后再做一次跳转串接（jump threading）：跳到另一条跳转指令的跳转
+ * 直接改为跳到最终位置。执行时是一个紧凑的循环，上下文以指针加长度传入，不复制字符串
+ * （项目使用 C++11，没有 std::string_view）。
+ *
+ * 运行 `interpreter_bytecode bench [rules]` 与虚函数递归的实现做性能对比。
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+class Program {
+public:
+    enum OpCode : uint8_t {
+        MATCH,
+        JUMP_IF_TRUE,
+        JUMP_IF_FALSE
+    };
+
+    struct Instruction {
+        OpCode op;
+        uint32_t arg;
+    };
+
+    size_t size() const {
+        return m_code.size();
+    }
+
+    //上下文中依次执行字节码，返回最终累加器的值
+    bool run(const char* context, size_t size) const {
+        bool acc = false;
+        size_t pc = 0;
+        const Instruction* code = m_code.data();
+        size_t end = m_code.size();
+
+        while (pc < end) {
+            const Instruction& inst = code[pc];
+
+            switch (inst.op) {
+            case MATCH: {
+                const Pattern& pattern = m_patterns[inst.arg];
+                acc = memmem(context, size, m_arena.data() + pattern.offset, pattern.size) != nullptr;
+                ++pc;
+                break;
+            }
+
+            case JUMP_IF_TRUE:
+                pc = acc ? inst.arg : pc + 1;
+                break;
+
+            case JUMP_IF_FALSE:
+                pc = acc ? pc + 1 : inst.arg;
+                break;
+            }
+        }
+
+        return acc;
+    }
+
+    bool run(const std::string& context) const {
+        return run(context.data(), context.size());
+    }
+
+    void dump(std::ostream& out) const {
+        for (size_t pc = 0; pc < m_code.size(); ++pc) {
+            const Instruction& inst = m_code[pc];
+            out << pc << ": ";
+
+            if (inst.op == MATCH) {
+                const Pattern& pattern = m_patterns[inst.arg];
+                out << "MATCH \"" << std::string(m_arena.data() + pattern.offset, pattern.size) << "\"";
+            } else {
+                out << (inst.op == JUMP_IF_TRUE ? "JUMP_IF_TRUE " : "JUMP_IF_FALSE ") << inst.arg;
+            }
+
+            out << std::endl;
+        }
+    }
+
+private:
+    friend class ExpressionCompiler;
+
+    struct Pattern {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    std::vector<Instruction> m_code;
+    std::vector<Pattern> m_patterns;
+    std::vector<char> m_arena;
+};
+
+class ExpressionCompiler;
+
+class Expression {
+public:
+    virtual bool interpret(std::string context) = 0;
+    virtual void compile(ExpressionCompiler& compiler) const = 0;
+    virtual ~Expression() = default;
+};
+
+class ExpressionCompiler {
+public:
+    Program compile(const Expression& expression) {
+        m_program = Program();
+        expression.compile(*this);
+        threadJumps();
+        return m_program;
+    }
+
+    void emitMatch(const std::string& data) {
+        Program::Pattern pattern = {(uint32_t)m_program.m_arena.size(), (uint32_t)data.size()};
+        m_program.m_arena.insert(m_program.m_arena.end(), data.begin(), data.end());
+        m_program.m_patterns.push_back(pattern);
+        emit(Program::MATCH, (uint32_t)m_program.m_patterns.size() - 1);
+    }
+
+    //发出一条目标待定的跳转指令，返回它的位置
+    size_t emitJump(Program::OpCode op) {
+        emit(op, 0);
+        return m_program.m_code.size() - 1;
+    }
+
+    //把 emitJump 发出的跳转指令的目标设为当前位置
+    void patchJump(size_t pc) {
+        m_program.m_code[pc].arg = (uint32_t)m_program.m_code.size();
+    }
+
+private:
+    void emit(Program::OpCode op, uint32_t arg) {
+        Program::Instruction inst = {op, arg};
+        m_program.m_code.push_back(inst);
+    }
+
+    //跳转不改变累加器：跳到同类跳转时直接跳到它的目标，跳到相反的跳转时它一定不会跳，直接落到下一条
+    void threadJumps() {
+        std::vector<Program::Instruction>& code = m_program.m_code;
+
+        for (auto& inst : code) {
+            if (inst.op == Program::MATCH) {
+                continue;
+            }
+
+            uint32_t target = inst.arg;
+
+            while (target < code.size() && code[target].op != Program::MATCH) {
+                target = code[target].op == inst.op ? code[target].arg : target + 1;
+            }
+
+            inst.arg = target;
+        }
+    }
+
+    Program m_program;
+};
+
+class TerminalExpression: public Expression {
+public:
+    TerminalExpression(std::string data) : m_data(data) {}
+
+    virtual bool interpret(std::string context) override {
+        if (context.find(m_data) != std::string::npos) {
+            return true;
+        }
+
+        return false;
+    }
+
+    virtual void compile(ExpressionCompiler& compiler) const override {
+        compiler.emitMatch(m_data);
+    }
+
+private:
+    std::string m_data;
+};
+
+class OrExpression: public Expression {
+public:
+    OrExpression(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) : m_expr1(expr1),
+        m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) || m_expr2->interpret(context);
+    }
+
+    virtual void compile(ExpressionCompiler& compiler) const override {
+        m_expr1->compile(compiler);
+        size_t jump = compiler.emitJump(Program::JUMP_IF_TRUE);
+        m_expr2->compile(compiler);
+        compiler.patchJump(jump);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+class AndExpression: public Expression {
+public:
+    AndExpression(std::shared_ptr<Expression> expr1,
+                  std::shared_ptr<Expression> expr2) : m_expr1(expr1), m_expr2(expr2) {}
+
+    virtual bool interpret(std::string context) override {
+        return m_expr1->interpret(context) && m_expr2->interpret(context);
+    }
+
+    virtual void compile(ExpressionCompiler& compiler) const override {
+        m_expr1->compile(compiler);
+        size_t jump = compiler.emitJump(Program::JUMP_IF_FALSE);
+        m_expr2->compile(compiler);
+        compiler.patchJump(jump);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+//规则：Robert 和 John 是男性
+static std::shared_ptr<Expression> getMaleExpression() {
+    std::shared_ptr<Expression> robert = std::make_shared<TerminalExpression>("Robert");
+    std::shared_ptr<Expression> john = std::make_shared<TerminalExpression>("John");
+    return std::make_shared<OrExpression>(robert, john);
+}
+
+//规则：Julie 是一个已婚的女性
+static std::shared_ptr<Expression> getMarriedWomanExpression() {
+    std::shared_ptr<Expression> julie = std::make_shared<TerminalExpression>("Julie");
+    std::shared_ptr<Expression> married = std::make_shared<TerminalExpression>("Married");
+    return std::make_shared<AndExpression>(julie, married);
+}
+
+//随机生成一棵有 leaves 个终结符的表达式树
+static std::shared_ptr<Expression> randomExpression(std::default_random_engine& engine, int leaves) {
+    if (leaves == 1) {
+        std::uniform_int_distribution<int> word(0, 50);
+        return std::make_shared<TerminalExpression>("w" + std::to_string(word(engine)) + " ");
+    }
+
+    std::uniform_int_distribution<int> split(1, leaves - 1);
+    int left = split(engine);
+    std::shared_ptr<Expression> expr1 = randomExpression(engine, left);
+    std::shared_ptr<Expression> expr2 = randomExpression(engine, leaves - left);
+
+    if (std::uniform_int_distribution<int>(0, 1)(engine)) {
+        return std::make_shared<OrExpression>(expr1, expr2);
+    }
+
+    return std::make_shared<AndExpression>(expr1, expr2);
+}
+
+static int bench(size_t ruleCount) {
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> word(0, 50);
+    std::vector<std::shared_ptr<Expression>> rules;
+    std::vector<Program> programs;
+    ExpressionCompiler compiler;
+
+    for (size_t i = 0; i < ruleCount; ++i) {
+        rules.push_back(randomExpression(engine, 16));
+        programs.push_back(compiler.compile(*rules.back()));
+    }
+
+    std::vector<std::string> contexts;
+
+    for (int i = 0; i < 1000; ++i) {
+        std::string context;
+
+        //上下文足够长，按值传参时无法使用短字符串优化
+        for (int j = 0; j < 20; ++j) {
+            context += "w" + std::to_string(word(engine)) + " ";
+        }
+
+        contexts.push_back(context);
+    }
+
+    size_t virtualMatches = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& context : contexts) {
+        for (auto rule : rules) {
+            virtualMatches += rule->interpret(context);
+        }
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+    size_t compiledMatches = 0;
+
+    for (auto& context : contexts) {
+        for (auto& program : programs) {
+            compiledMatches += program.run(context);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "rules: " << ruleCount << " (16 terminals each), contexts: " << contexts.size() << std::endl;
+    std::cout << "virtual: " << virtualMatches << " matches, " <<
+              std::chrono::duration<double, std::milli>(middle - start).count() << " ms" << std::endl;
+    std::cout << "bytecode: " << compiledMatches << " matches, " <<
+              std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+
+    return virtualMatches == compiledMatches ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000);
+    }
+
+    ExpressionCompiler compiler;
+    Program isMale = compiler.compile(*getMaleExpression());
+    Program isMarriedWoman = compiler.compile(*getMarriedWomanExpression());
+
+    std::cout << "isMale:" << std::endl;
+    isMale.dump(std::cout);
+    std::cout << "isMarriedWoman:" << std::endl;
+    isMarriedWoman.dump(std::cout);
+
+    std::cout << "John is male? " << isMale.run("John") << std::endl;
+    std::cout << "Julie is a married women? " << isMarriedWoman.run("Married Julie") << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * 解释器模式（Interpreter Pattern）的哈希共享（hash-consing）与公共子表达式消除
+ *
+ * 用 getMaleExpression()、getMarriedWomanExpression() 这样的辅助函数拼出大量规则时，
+ * 相同的 TerminalExpression("John") 以及相同的子树会被重复创建，对同一个上下文也会被重复求值。
+ *
+ * 这里用 ExpressionBuilder 创建表达式：结构相同的节点只创建一次（And/Or 的两个子节点按编号排序，
+ * 交换律等价的节点也能共享），所有规则组成一个有向无环图。每个节点有一个连续的编号，
+ * 求值时用 EvaluationCache 按编号缓存本次上下文的结果，共享的子表达式对每个上下文只计算一次。
+ * 缓存用轮次（epoch）标记是否有效，切换上下文时不需要清空。
+ *
+ * 运行 `interpreter_hashcons bench [rules]` 输出共享前后的节点数、内存与求值耗时。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class EvaluationCache {
+public:
+    EvaluationCache() : m_epoch(0) {}
+
+    //开始一个新的上下文，之前缓存的结果全部失效
+    void reset(size_t nodes) {
+        if (m_stamps.size() < nodes) {
+            m_stamps.resize(nodes, 0);
+            m_values.resize(nodes, 0);
+        }
+
+        if (++m_epoch == 0) {
+            std::fill(m_stamps.begin(), m_stamps.end(), 0);
+            m_epoch = 1;
+        }
+    }
+
+    bool lookup(size_t id, bool& value) const {
+        if (m_stamps[id] != m_epoch) {
+            return false;
+        }
+
+        value = m_values[id] != 0;
+        return true;
+    }
+
+    void store(size_t id, bool value) {
+        m_stamps[id] = m_epoch;
+        m_values[id] = value;
+    }
+
+private:
+    std::vector<uint32_t> m_stamps;
+    std::vector<uint8_t> m_values;
+    uint32_t m_epoch;
+};
+
+class Expression {
+public:
+    Expression(size_t id) : m_id(id) {}
+    virtual ~Expression() = default;
+
+    size_t getId() const {
+        return m_id;
+    }
+
+    bool interpret(const std::string& context, EvaluationCache& cache) const {
+        bool value;
+
+        if (!cache.lookup(m_id, value)) {
+            value = compute(context, cache);
+            cache.store(m_id, value);
+        }
+
+        return value;
+    }
+
+protected:
+    virtual bool compute(const std::string& context, EvaluationCache& cache) const = 0;
+
+private:
+    size_t m_id;
+};
+
+class TerminalExpression: public Expression {
+public:
+    TerminalExpression(size_t id, std::string data) : Expression(id), m_data(data) {}
+
+    const std::string& getData() const {
+        return m_data;
+    }
+
+protected:
+    virtual bool compute(const std::string& context, EvaluationCache&) const override {
+        return context.find(m_data) != std::string::npos;
+    }
+
+private:
+    std::string m_data;
+};
+
+class OrExpression: public Expression {
+public:
+    OrExpression(size_t id, std::shared_ptr<Expression> expr1,
+                 std::shared_ptr<Expression> expr2) : Expression(id), m_expr1(expr1), m_expr2(expr2) {}
+
+protected:
+    virtual bool compute(const std::string& context, EvaluationCache& cache) const override {
+        return m_expr1->interpret(context, cache) || m_expr2->interpret(context, cache);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+class AndExpression: public Expression {
+public:
+    AndExpression(size_t id, std::shared_ptr<Expression> expr1,
+                  std::shared_ptr<Expression> expr2) : Expression(id), m_expr1(expr1), m_expr2(expr2) {}
+
+protected:
+    virtual bool compute(const std::string& context, EvaluationCache& cache) const override {
+        return m_expr1->interpret(context, cache) && m_expr2->interpret(context, cache);
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr1;
+    std::shared_ptr<Expression> m_expr2;
+};
+
+//表达式工厂：结构相同的节点只创建一次
+class ExpressionBuilder {
+public:
+    //share 为 false 时每次都创建新节点，仅用于对比
+    ExpressionBuilder(bool share = true) : m_share(share), m_bytes(0) {}
+
+    std::shared_ptr<Expression> terminal(const std::string& data) {
+        if (m_share) {
+            auto it = m_terminals.find(data);
+
+            if (it != m_terminals.end()) {
+                return it->second;
+            }
+        }
+
+        std::shared_ptr<TerminalExpression> expr = std::make_shared<TerminalExpression>(m_nodes.size(), data);
+        m_bytes += sizeof(TerminalExpression) + expr->getData().capacity();
+        add(expr);
+
+        if (m_share) {
+            m_terminals[data] = expr;
+        }
+
+        return expr;
+    }
+
+    std::shared_ptr<Expression> orOf(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) {
+        return binary(Or, expr1, expr2);
+    }
+
+    std::shared_ptr<Expression> andOf(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) {
+        return binary(And, expr1, expr2);
+    }
+
+    //EvaluationCache 需要的编号范围
+    size_t getNodeCount() const {
+        return m_nodes.size();
+    }
+
+    //节点对象与关键字占用的内存（不含 shared_ptr 控制块和查找表）
+    size_t getApproxBytes() const {
+        return m_bytes;
+    }
+
+private:
+    enum Kind {
+        Or,
+        And
+    };
+
+    struct Key {
+        Kind kind;
+        size_t left;
+        size_t right;
+
+        bool operator==(const Key& other) const {
+            return kind == other.kind && left == other.left && right == other.right;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t h = std::hash<size_t>()(key.left);
+            h ^= std::hash<size_t>()(key.right) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            return h ^ key.kind;
+        }
+    };
+
+    std::shared_ptr<Expression> binary(Kind kind, std::shared_ptr<Expression> expr1,
+                                       std::shared_ptr<Expression> expr2) {
+        //与、或满足交换律，按编号排序后 a | b 与 b | a 共享同一个节点
+        if (m_share && expr2->getId() < expr1->getId()) {
+            std::swap(expr1, expr2);
+        }
+
+        Key key = {kind, expr1->getId(), expr2->getId()};
+
+        if (m_share) {
+            auto it = m_binaries.find(key);
+
+            if (it != m_binaries.end()) {
+                return it->second;
+            }
+        }
+
+        std::shared_ptr<Expression> expr;
+
+        if (kind == Or) {
+            expr = std::make_shared<OrExpression>(m_nodes.size(), expr1, expr2);
+            m_bytes += sizeof(OrExpression);
+        } else {
+            expr = std::make_shared<AndExpression>(m_nodes.size(), expr1, expr2);
+            m_bytes += sizeof(AndExpression);
+        }
+
+        add(expr);
+
+        if (m_share) {
+            m_binaries[key] = expr;
+        }
+
+        return expr;
+    }
+
+    void add(std::shared_ptr<Expression> expr) {
+        m_nodes.push_back(expr);
+    }
+
+    bool m_share;
+    size_t m_bytes;
+    std::vector<std::shared_ptr<Expression>> m_nodes;
+    std::unordered_map<std::string, std::shared_ptr<Expression>> m_terminals;
+    std::unordered_map<Key, std::shared_ptr<Expression>, KeyHash> m_binaries;
+};
+
+//规则：Robert 和 John 是男性
+static std::shared_ptr<Expression> getMaleExpression(ExpressionBuilder& builder) {
+    return builder.orOf(builder.terminal("Robert"), builder.terminal("John"));
+}
+
+//规则：Julie 是一个已婚的女性
+static std::shared_ptr<Expression> getMarriedWomanExpression(ExpressionBuilder& builder) {
+    return builder.andOf(builder.terminal("Julie"), builder.terminal("Married"));
+}
+
+//第 i 条规则：(男性 或 已婚女性) 并且 包含第 i % 100 个城市，或者 包含第 i 个用户名
+static std::vector<std::shared_ptr<Expression>> buildRules(ExpressionBuilder& builder, size_t count) {
+    std::vector<std::shared_ptr<Expression>> rules;
+
+    for (size_t i = 0; i < count; ++i) {
+        std::shared_ptr<Expression> person = builder.orOf(getMaleExpression(builder),
+                                             getMarriedWomanExpression(builder));
+        std::shared_ptr<Expression> city = builder.terminal("city" + std::to_string(i % 100) + ";");
+        std::shared_ptr<Expression> user = builder.terminal("user" + std::to_string(i) + ";");
+        rules.push_back(builder.orOf(builder.andOf(person, city), user));
+    }
+
+    return rules;
+}
+
+static size_t evaluateAll(const std::vector<std::shared_ptr<Expression>>& rules, size_t nodes,
+                          const std::vector<std::string>& contexts) {
+    EvaluationCache cache;
+    size_t matches = 0;
+
+    for (auto& context : contexts) {
+        cache.reset(nodes);
+
+        for (auto rule : rules) {
+            matches += rule->interpret(context, cache);
+        }
+    }
+
+    return matches;
+}
+
+static int bench(size_t ruleCount) {
+    ExpressionBuilder treeBuilder(false);
+    ExpressionBuilder dagBuilder;
+    std::vector<std::shared_ptr<Expression>> tree = buildRules(treeBuilder, ruleCount);
+    std::vector<std::shared_ptr<Expression>> dag = buildRules(dagBuilder, ruleCount);
+
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> name(0, 3);
+    std::uniform_int_distribution<size_t> number(0, ruleCount);
+    const char* names[] = {"Robert", "John", "Julie Married", "Laura"};
+    std::vector<std::string> contexts;
+
+    for (int i = 0; i < 200; ++i) {
+        contexts.push_back(std::string(names[name(engine)]) + " city" + std::to_string(number(engine) % 100) +
+                           "; user" + std::to_string(number(engine)) + ";");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t treeMatches = evaluateAll(tree, treeBuilder.getNodeCount(), contexts);
+    auto middle = std::chrono::steady_clock::now();
+    size_t dagMatches = evaluateAll(dag, dagBuilder.getNodeCount(), contexts);
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "rules: " << ruleCount << ", contexts: " << contexts.size() << std::endl;
+    std::cout << "tree: " << treeBuilder.getNodeCount() << " nodes, " << treeBuilder.getApproxBytes() / 1024 <<
+              " KB, " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms" << std::endl;
+    std::cout << "dag:  " << dagBuilder.getNodeCount() << " nodes, " << dagBuilder.getApproxBytes() / 1024 <<
+              " KB, " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+
+    return treeMatches == dagMatches ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 10000);
+    }
+
+    ExpressionBuilder builder;
+    std::shared_ptr<Expression> isMale = getMaleExpression(builder);
+    std::shared_ptr<Expression> isMarriedWoman = getMarriedWomanExpression(builder);
+    std::shared_ptr<Expression> isMaleAgain = builder.orOf(builder.terminal("John"),
+            builder.terminal("Robert"));
+
+    std::cout << "shared nodes: " << builder.getNodeCount() << std::endl;
+    std::cout << "John | Robert is the same node as Robert | John? " << (isMale == isMaleAgain) << std::endl;
+
+    EvaluationCache cache;
+    cache.reset(builder.getNodeCount());
+    std::cout << "John is male? " << isMale->interpret("John", cache) << std::endl;
+
+    cache.reset(builder.getNodeCount());
+    std::cout << "Julie is a married women? " << isMarriedWoman->interpret("Married Julie", cache) <<
+              std::endl;
+
+    return 0;
+}
@@ -0,0 +1,626 @@
+/**
+ * 解释器模式（Interpreter Pattern）的规则解析与优化
+ *
+ * interpreter.cpp 中的规则是在 C++ 代码里手工拼出来的，例如 getMaleExpression()。
+ * 这里增加一个小的布尔规则语言，启动时从文本加载规则：
+ *
+ *      expr    := orExpr
+ *      orExpr  := andExpr ("OR" andExpr)*
+ *      andExpr := notExpr ("AND" notExpr)*
+ *      notExpr := "NOT" notExpr | primary
+ *      primary := "(" expr ")" | "TRUE" | "FALSE" | term
+ *      term    := 不含空白和括号的单词，或者双引号括起来的字符串（支持 \" 与 \\ 转义）
+ *
+ * 括号与 NOT 的嵌套层数不能超过 RuleParser::MaxDepth，超过时报解析错误，避免递归下降把栈用完。
+ *
+ * 解析后再做一遍优化：
+ *      1、展开嵌套的 Or/And：(a OR (b OR c)) 变成 OR(a, b, c)。
+ *      2、常量折叠：TRUE/FALSE、空关键字（总是匹配）、NOT NOT x、只有一个子节点的 And/Or。
+ *      3、去掉结构相同的重复子节点：优化后的节点都经过 hash-consing，结构相同的节点是同一个对象，
+ *         所以按指针去重即可，不需要生成文本。
+ *      4、子节点排序：估算每个节点的代价与命中概率（关键字越长越不容易命中），
+ *         And 把最可能失败的放前面，Or 把最可能命中的放前面，与 filter_planner.cpp 的排序方式相同。
+ * 节点创建后不再修改，哈希、代价与命中概率在构造时算好，排序与去重时不会递归。
+ *
+ * 运行 `interpreter_parser bench [rules]` 输出解析并优化 10 万条规则的耗时。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Expression {
+public:
+    Expression() : m_hash(0), m_cost(0), m_probability(0) {}
+
+    virtual bool interpret(const std::string& context) const = 0;
+    //规范的文本形式
+    virtual std::string toString() const = 0;
+    //只比较本节点的值与直接子节点的指针，子节点都经过 hash-consing 时等价于结构相同
+    virtual bool isShallowEqual(const Expression& other) const = 0;
+    virtual ~Expression() = default;
+
+    //结构哈希，结构相同的节点哈希相同
+    size_t getHash() const {
+        return m_hash;
+    }
+
+    //每次求值需要做的子串查找次数
+    double getCost() const {
+        return m_cost;
+    }
+
+    //估算的命中概率
+    double getProbability() const {
+        return m_probability;
+    }
+
+protected:
+    static size_t combine(size_t seed, size_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+
+    size_t m_hash;
+    double m_cost;
+    double m_probability;
+};
+
+class ConstantExpression: public Expression {
+public:
+    ConstantExpression(bool value) : m_value(value) {
+        m_hash = value ? 1 : 2;
+        m_probability = value ? 1 : 0;
+    }
+
+    bool getValue() const {
+        return m_value;
+    }
+
+    virtual bool interpret(const std::string&) const override {
+        return m_value;
+    }
+
+    virtual std::string toString() const override {
+        return m_value ? "TRUE" : "FALSE";
+    }
+
+    virtual bool isShallowEqual(const Expression& other) const override {
+        return typeid(other) == typeid(*this) && static_cast<const ConstantExpression&>(other).m_value == m_value;
+    }
+
+private:
+    bool m_value;
+};
+
+class TerminalExpression: public Expression {
+public:
+    TerminalExpression(std::string data) : m_data(data) {
+        m_hash = combine(3, std::hash<std::string>()(m_data));
+        m_cost = 1;
+        m_probability = 1.0 / (1 + m_data.size());
+    }
+
+    const std::string& getData() const {
+        return m_data;
+    }
+
+    virtual bool interpret(const std::string& context) const override {
+        return context.find(m_data) != std::string::npos;
+    }
+
+    virtual std::string toString() const override {
+        std::string text = "\"";
+
+        for (char c : m_data) {
+            if (c == '"' || c == '\\') {
+                text += '\\';
+            }
+
+            text += c;
+        }
+
+        return text + "\"";
+    }
+
+    virtual bool isShallowEqual(const Expression& other) const override {
+        return typeid(other) == typeid(*this) && static_cast<const TerminalExpression&>(other).m_data == m_data;
+    }
+
+private:
+    std::string m_data;
+};
+
+class NotExpression: public Expression {
+public:
+    NotExpression(std::shared_ptr<Expression> expr) : m_expr(expr) {
+        m_hash = combine(4, expr->getHash());
+        m_cost = expr->getCost();
+        m_probability = 1 - expr->getProbability();
+    }
+
+    std::shared_ptr<Expression> getExpression() const {
+        return m_expr;
+    }
+
+    virtual bool interpret(const std::string& context) const override {
+        return !m_expr->interpret(context);
+    }
+
+    virtual std::string toString() const override {
+        return "NOT " + m_expr->toString();
+    }
+
+    virtual bool isShallowEqual(const Expression& other) const override {
+        return typeid(other) == typeid(*this) && static_cast<const NotExpression&>(other).m_expr == m_expr;
+    }
+
+private:
+    std::shared_ptr<Expression> m_expr;
+};
+
+using expressions_t = std::vector<std::shared_ptr<Expression>>;
+
+class CompositeExpression: public Expression {
+public:
+    CompositeExpression(expressions_t exprs, size_t seed) : m_exprs(exprs) {
+        m_hash = seed;
+
+        for (auto expr : m_exprs) {
+            m_hash = combine(m_hash, expr->getHash());
+        }
+    }
+
+    const expressions_t& getExpressions() const {
+        return m_exprs;
+    }
+
+    virtual bool isShallowEqual(const Expression& other) const override {
+        return typeid(other) == typeid(*this) && static_cast<const CompositeExpression&>(other).m_exprs == m_exprs;
+    }
+
+protected:
+    std::string join(const char* op) const {
+        std::string text = "(";
+
+        for (size_t i = 0; i < m_exprs.size(); ++i) {
+            text += (i == 0 ? "" : op) + m_exprs[i]->toString();
+        }
+
+        return text + ")";
+    }
+
+    expressions_t m_exprs;
+};
+
+class OrExpression: public CompositeExpression {
+public:
+    //排在后面的子节点只有前面都没命中时才会执行
+    OrExpression(expressions_t exprs) : CompositeExpression(exprs, 5) {
+        double remaining = 1;
+
+        for (auto expr : m_exprs) {
+            m_cost += remaining * expr->getCost();
+            remaining *= 1 - expr->getProbability();
+        }
+
+        m_probability = 1 - remaining;
+    }
+
+    virtual bool interpret(const std::string& context) const override {
+        for (auto expr : m_exprs) {
+            if (expr->interpret(context)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    virtual std::string toString() const override {
+        return join(" OR ");
+    }
+};
+
+class AndExpression: public CompositeExpression {
+public:
+    //排在后面的子节点只有前面都命中时才会执行
+    AndExpression(expressions_t exprs) : CompositeExpression(exprs, 6) {
+        double passed = 1;
+
+        for (auto expr : m_exprs) {
+            m_cost += passed * expr->getCost();
+            passed *= expr->getProbability();
+        }
+
+        m_probability = passed;
+    }
+
+    virtual bool interpret(const std::string& context) const override {
+        for (auto expr : m_exprs) {
+            if (!expr->interpret(context)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    virtual std::string toString() const override {
+        return join(" AND ");
+    }
+};
+
+class RuleParser {
+public:
+    //括号与 NOT 的最大嵌套层数
+    static const size_t MaxDepth = 256;
+
+    std::shared_ptr<Expression> parse(const std::string& text) {
+        m_text = &text;
+        m_pos = 0;
+        m_depth = 0;
+        next();
+        std::shared_ptr<Expression> expr = parseOr();
+
+        if (m_token != End) {
+            error("unexpected token");
+        }
+
+        return expr;
+    }
+
+private:
+    enum Token {
+        End,
+        LeftParen,
+        RightParen,
+        And,
+        Or,
+        Not,
+        True,
+        False,
+        Term
+    };
+
+    [[noreturn]] void error(const char* message) const {
+        throw std::invalid_argument(std::string(message) + " at offset " + std::to_string(m_tokenPos) +
+                                    " in rule: " + *m_text);
+    }
+
+    void enter() {
+        if (++m_depth > MaxDepth) {
+            error("nesting too deep");
+        }
+    }
+
+    void next() {
+        const std::string& text = *m_text;
+
+        while (m_pos < text.size() && std::isspace((unsigned char)text[m_pos])) {
+            ++m_pos;
+        }
+
+        m_tokenPos = m_pos;
+
+        if (m_pos == text.size()) {
+            m_token = End;
+        } else if (text[m_pos] == '(') {
+            m_token = LeftParen;
+            ++m_pos;
+        } else if (text[m_pos] == ')') {
+            m_token = RightParen;
+            ++m_pos;
+        } else if (text[m_pos] == '"') {
+            m_token = Term;
+            m_term.clear();
+
+            for (++m_pos; m_pos < text.size() && text[m_pos] != '"'; ++m_pos) {
+                if (text[m_pos] == '\\' && m_pos + 1 < text.size()) {
+                    ++m_pos;
+                }
+
+                m_term += text[m_pos];
+            }
+
+            if (m_pos == text.size()) {
+                error("unterminated string");
+            }
+
+            ++m_pos;
+        } else {
+            size_t begin = m_pos;
+
+            while (m_pos < text.size() && !std::isspace((unsigned char)text[m_pos]) && text[m_pos] != '(' &&
+                    text[m_pos] != ')' && text[m_pos] != '"') {
+                ++m_pos;
+            }
+
+            m_term.assign(text, begin, m_pos - begin);
+
+            if (m_term == "AND") {
+                m_token = And;
+            } else if (m_term == "OR") {
+                m_token = Or;
+            } else if (m_term == "NOT") {
+                m_token = Not;
+            } else if (m_term == "TRUE") {
+                m_token = True;
+            } else if (m_term == "FALSE") {
+                m_token = False;
+            } else {
+                m_token = Term;
+            }
+        }
+    }
+
+    std::shared_ptr<Expression> parseOr() {
+        expressions_t exprs = {parseAnd()};
+
+        while (m_token == Or) {
+            next();
+            exprs.push_back(parseAnd());
+        }
+
+        return exprs.size() == 1 ? exprs[0] : std::make_shared<OrExpression>(exprs);
+    }
+
+    std::shared_ptr<Expression> parseAnd() {
+        expressions_t exprs = {parseNot()};
+
+        while (m_token == And) {
+            next();
+            exprs.push_back(parseNot());
+        }
+
+        return exprs.size() == 1 ? exprs[0] : std::make_shared<AndExpression>(exprs);
+    }
+
+    std::shared_ptr<Expression> parseNot() {
+        if (m_token == Not) {
+            enter();
+            next();
+            std::shared_ptr<Expression> expr = std::make_shared<NotExpression>(parseNot());
+            --m_depth;
+            return expr;
+        }
+
+        return parsePrimary();
+    }
+
+    std::shared_ptr<Expression> parsePrimary() {
+        std::shared_ptr<Expression> expr;
+
+        switch (m_token) {
+        case LeftParen:
+            enter();
+            next();
+            expr = parseOr();
+
+            if (m_token != RightParen) {
+                error("expected ')'");
+            }
+
+            --m_depth;
+            break;
+
+        case True:
+        case False:
+            expr = std::make_shared<ConstantExpression>(m_token == True);
+            break;
+
+        case Term:
+            expr = std::make_shared<TerminalExpression>(m_term);
+            break;
+
+        default:
+            error("expected term");
+        }
+
+        next();
+        return expr;
+    }
+
+    const std::string* m_text;
+    size_t m_pos;
+    size_t m_tokenPos;
+    size_t m_depth;
+    Token m_token;
+    std::string m_term;
+};
+
+//优化器存活期间，所有规则中结构相同的子表达式共享同一个节点
+class RuleOptimizer {
+public:
+    std::shared_ptr<Expression> optimize(std::shared_ptr<Expression> expr) {
+        std::shared_ptr<TerminalExpression> terminal = std::dynamic_pointer_cast<TerminalExpression>(expr);
+
+        //空关键字总是匹配
+        if (terminal) {
+            return intern(terminal->getData().empty() ? std::make_shared<ConstantExpression>(true) : expr);
+        }
+
+        std::shared_ptr<NotExpression> notExpr = std::dynamic_pointer_cast<NotExpression>(expr);
+
+        if (notExpr) {
+            std::shared_ptr<Expression> inner = optimize(notExpr->getExpression());
+            std::shared_ptr<NotExpression> innerNot = std::dynamic_pointer_cast<NotExpression>(inner);
+            std::shared_ptr<ConstantExpression> constant = std::dynamic_pointer_cast<ConstantExpression>(inner);
+
+            if (innerNot) {
+                return innerNot->getExpression();
+            }
+
+            if (constant) {
+                return intern(std::make_shared<ConstantExpression>(!constant->getValue()));
+            }
+
+            return intern(std::make_shared<NotExpression>(inner));
+        }
+
+        std::shared_ptr<CompositeExpression> composite = std::dynamic_pointer_cast<CompositeExpression>(expr);
+
+        if (!composite) {
+            return intern(expr);
+        }
+
+        bool isAnd = std::dynamic_pointer_cast<AndExpression>(expr) != nullptr;
+        expressions_t children;
+        std::unordered_set<const Expression*> seen;
+
+        if (!flatten(composite, isAnd, children, seen)) {
+            //And 中出现 FALSE，或者 Or 中出现 TRUE
+            return intern(std::make_shared<ConstantExpression>(!isAnd));
+        }
+
+        if (children.empty()) {
+            return intern(std::make_shared<ConstantExpression>(isAnd));
+        }
+
+        if (children.size() == 1) {
+            return children[0];
+        }
+
+        std::stable_sort(children.begin(), children.end(), [isAnd](const std::shared_ptr<Expression>& a,
+        const std::shared_ptr<Expression>& b) {
+            double pa = isAnd ? 1 - a->getProbability() : a->getProbability();
+            double pb = isAnd ? 1 - b->getProbability() : b->getProbability();
+            return pa * b->getCost() > pb * a->getCost();
+        });
+
+        if (isAnd) {
+            return intern(std::make_shared<AndExpression>(children));
+        }
+
+        return intern(std::make_shared<OrExpression>(children));
+    }
+
+private:
+    //子节点已经是共享的节点，按哈希找到候选后只需要浅比较
+    std::shared_ptr<Expression> intern(std::shared_ptr<Expression> expr) {
+        auto range = m_nodes.equal_range(expr->getHash());
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->isShallowEqual(*expr)) {
+                return it->second;
+            }
+        }
+
+        m_nodes.emplace(expr->getHash(), expr);
+        return expr;
+    }
+
+    //把同类的子节点展开到 children 中，遇到决定结果的常量时返回 false
+    bool flatten(std::shared_ptr<CompositeExpression> composite, bool isAnd, expressions_t& children,
+                 std::unordered_set<const Expression*>& seen) {
+        for (auto child : composite->getExpressions()) {
+            std::shared_ptr<Expression> optimized = optimize(child);
+            std::shared_ptr<ConstantExpression> constant = std::dynamic_pointer_cast<ConstantExpression>(optimized);
+
+            if (constant) {
+                if (constant->getValue() != isAnd) {
+                    return false;
+                }
+
+                continue;
+            }
+
+            std::shared_ptr<CompositeExpression> nested = std::dynamic_pointer_cast<CompositeExpression>(optimized);
+
+            if (nested && (std::dynamic_pointer_cast<AndExpression>(optimized) != nullptr) == isAnd) {
+                for (auto grandChild : nested->getExpressions()) {
+                    if (seen.insert(grandChild.get()).second) {
+                        children.push_back(grandChild);
+                    }
+                }
+            } else if (seen.insert(optimized.get()).second) {
+                children.push_back(optimized);
+            }
+        }
+
+        return true;
+    }
+
+    std::unordered_multimap<size_t, std::shared_ptr<Expression>> m_nodes;
+};
+
+static int bench(size_t ruleCount) {
+    const char* names[] = {"Robert", "John", "Julie", "Laura", "Diana", "Mike", "Bobby", "Married", "Single"};
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> name(0, 8);
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::vector<std::string> texts;
+
+    for (size_t i = 0; i < ruleCount; ++i) {
+        std::string a = names[name(engine)];
+        std::string b = names[name(engine)];
+        std::string c = names[name(engine)];
+        texts.push_back("(" + a + (coin(engine) ? " OR " : " AND ") + "(" + b + " OR " + c + ")) AND NOT \"user" +
+                        std::to_string(i) + "\"");
+    }
+
+    RuleParser parser;
+    RuleOptimizer optimizer;
+    expressions_t rules;
+    rules.reserve(texts.size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& text : texts) {
+        rules.push_back(optimizer.optimize(parser.parse(text)));
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "parse and optimize " << ruleCount << " rules: " <<
+              std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+    std::cout << "example: " << texts[0] << std::endl;
+    std::cout << "      => " << rules[0]->toString() << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 100000);
+    }
+
+    RuleParser parser;
+    RuleOptimizer optimizer;
+
+    std::shared_ptr<Expression> isMale = optimizer.optimize(parser.parse("Robert OR John"));
+    std::shared_ptr<Expression> isMarriedWoman = optimizer.optimize(parser.parse("Julie AND Married"));
+
+    std::cout << "John is male? " << isMale->interpret("John") << std::endl;
+    std::cout << "Julie is a married women? " << isMarriedWoman->interpret("Married Julie") << std::endl;
+
+    const char* rules[] = {
+        "(John OR (Robert OR John)) AND TRUE AND NOT NOT Married",
+        "Julie AND (FALSE OR \"Married Julie\") AND Julie",
+        "NOT (Robert OR TRUE)",
+        "Robert AND (John"
+    };
+
+    for (const char* rule : rules) {
+        try {
+            std::shared_ptr<Expression> parsed = parser.parse(rule);
+            std::cout << "\n" << rule << std::endl;
+            std::cout << "  parsed:    " << parsed->toString() << std::endl;
+            std::cout << "  optimized: " << optimizer.optimize(parsed)->toString() << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "\nerror: " << e.what() << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+/**
+ * 备忘录模式（Memento Pattern）的后台增量快照
+ *
+ * memento.cpp 中 saveStateToMemento 在调用者的线程上复制整个 m_state，状态越大，保存时停顿越久，
+ * 几个 GB 的状态每次保存都要停顿几百毫秒。
+ *
+ * 这里的 Originator 把状态分成固定大小的块（chunk），保存时不复制任何数据：
+ *      1、saveStateToMemento 只把快照版本号加一，给新的 Memento 分配一块不初始化的缓冲区，
+ *         然后唤醒后台线程，停顿只有几微秒。
+ *      2、后台线程按顺序把每一块复制到 Memento 中，完成后 Memento 变为就绪，getState 会等待就绪。
+ *      3、写时复制：修改线程写一块之前，如果这一块还没有被后台线程复制，就先把它的旧内容复制到 Memento，
+ *         所以快照始终是保存那一刻的状态，修改线程最多复制一块，不会等待整个快照完成。
+ *      4、每一块有一把锁和一个版本号，后台线程与修改线程只在同一块上竞争。
+ * 同一时刻只有一个快照在进行，上一个快照还没有完成时再次保存会等待它完成。
+ * Originator 只允许一个修改线程。
+ *
+ * 运行 `memento_cow bench [stateMB] [saves]` 输出保存停顿与写入延迟的直方图，并与同步复制对比。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Memento {
+public:
+    Memento(std::string state) : m_data(new char[state.size()]), m_size(state.size()), m_ready(true) {
+        std::memcpy(m_data.get(), state.data(), m_size);
+    }
+
+    std::string getState() const {
+        return std::string(getData(), m_size);
+    }
+
+    //等待快照完成
+    const char* getData() const {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] {
+            return m_ready;
+        });
+        return m_data.get();
+    }
+
+    size_t getSize() const {
+        return m_size;
+    }
+
+    bool isReady() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ready;
+    }
+
+private:
+    friend class Originator;
+
+    //由 Originator 在后台填充，不初始化缓冲区
+    Memento(size_t size) : m_data(new char[size]), m_size(size), m_ready(false) {}
+
+    void markReady() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = true;
+        m_done.notify_all();
+    }
+
+    std::unique_ptr<char[]> m_data;
+    size_t m_size;
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_done;
+    bool m_ready;
+};
+
+class Originator {
+public:
+    Originator(size_t size, size_t chunkSize = 64 * 1024) : m_state(size, '\0'),
+        m_chunkSize(std::max<size_t>(chunkSize, 1)), m_chunks((size + m_chunkSize - 1) / m_chunkSize), m_epoch(0),
+        m_target(nullptr), m_jobEpoch(0), m_stop(false) {
+        m_thread = std::thread(&Originator::run, this);
+    }
+
+    Originator(const Originator&) = delete;
+    Originator& operator=(const Originator&) = delete;
+
+    ~Originator() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_work.notify_one();
+        }
+
+        m_thread.join();
+    }
+
+    void setState(const std::string& state) {
+        write(0, state.data(), std::min(state.size(), m_state.size()));
+    }
+
+    std::string getState() const {
+        return m_state;
+    }
+
+    //只能在修改线程中调用
+    const std::string& getData() const {
+        return m_state;
+    }
+
+    void write(size_t offset, const char* data, size_t length) {
+        while (length > 0) {
+            size_t index = offset / m_chunkSize;
+            size_t count = std::min(length, (index + 1) * m_chunkSize - offset);
+            Chunk& chunk = m_chunks[index];
+            std::lock_guard<std::mutex> lock(chunk.mutex);
+
+            //后台线程还没有复制这一块：先把旧内容放进快照
+            if (chunk.epoch < m_epoch) {
+                std::memcpy(m_target + index * m_chunkSize, &m_state[index * m_chunkSize], getChunkLength(index));
+                chunk.epoch = m_epoch;
+            }
+
+            std::memcpy(&m_state[offset], data, count);
+            offset += count;
+            data += count;
+            length -= count;
+        }
+    }
+
+    std::shared_ptr<Memento> saveStateToMemento() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] {
+            return m_job == nullptr;
+        });
+
+        //大块内存直接映射，页在第一次复制时才分配，这里不触碰它们
+        std::shared_ptr<Memento> memento(new Memento(m_state.size()));
+        m_target = memento->m_data.get();
+        m_job = memento;
+        m_jobEpoch = ++m_epoch;
+        m_work.notify_one();
+        return memento;
+    }
+
+    void getStateFromMemento(std::shared_ptr<Memento> memento) {
+        write(0, memento->getData(), std::min(memento->getSize(), m_state.size()));
+    }
+
+private:
+    struct Chunk {
+        Chunk() : epoch(0) {}
+
+        std::mutex mutex;
+        //这一块已经写入了哪个版本的快照
+        uint64_t epoch;
+    };
+
+    size_t getChunkLength(size_t index) const {
+        return std::min(m_chunkSize, m_state.size() - index * m_chunkSize);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_work.wait(lock, [this] {
+                return m_job != nullptr || m_stop;
+            });
+
+            if (m_job == nullptr) {
+                return;
+            }
+
+            std::shared_ptr<Memento> job = m_job;
+            uint64_t epoch = m_jobEpoch;
+            lock.unlock();
+
+            char* target = job->m_data.get();
+
+            for (size_t index = 0; index < m_chunks.size(); ++index) {
+                Chunk& chunk = m_chunks[index];
+                std::lock_guard<std::mutex> guard(chunk.mutex);
+
+                if (chunk.epoch < epoch) {
+                    std::memcpy(target + index * m_chunkSize, m_state.data() + index * m_chunkSize,
+                                getChunkLength(index));
+                    chunk.epoch = epoch;
+                }
+            }
+
+            job->markReady();
+            lock.lock();
+            m_job.reset();
+            m_idle.notify_all();
+
+            //调用者已经放弃这个快照时，在锁外释放它的缓冲区
+            lock.unlock();
+            job.reset();
+            lock.lock();
+        }
+    }
+
+    std::string m_state;
+    size_t m_chunkSize;
+    std::vector<Chunk> m_chunks;
+    //以下两个只由修改线程读写：最近一次保存的版本号，以及它的缓冲区
+    uint64_t m_epoch;
+    char* m_target;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::shared_ptr<Memento> m_job;
+    uint64_t m_jobEpoch;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+//以 2 为底的对数直方图（纳秒）
+class PauseHistogram {
+public:
+    PauseHistogram() : m_count(0), m_maxNs(0) {
+        std::memset(m_buckets, 0, sizeof(m_buckets));
+    }
+
+    void record(std::chrono::steady_clock::duration duration) {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        ++m_buckets[63 - __builtin_clzll(ns | 1)];
+        ++m_count;
+        m_maxNs = std::max(m_maxNs, ns);
+    }
+
+    //p 分位的上界（纳秒），精度为 2 倍
+    uint64_t percentile(double p) const {
+        uint64_t seen = 0;
+
+        for (int bucket = 0; bucket < 64; ++bucket) {
+            seen += m_buckets[bucket];
+
+            if (seen > 0 && seen >= m_count * p) {
+                return uint64_t(2) << bucket;
+            }
+        }
+
+        return 0;
+    }
+
+    void print(const std::string& name) const {
+        std::cout << name << ": " << m_count << " samples, p50 < " << percentile(0.5) / 1000.0 << " us, p99 < " <<
+                  percentile(0.99) / 1000.0 << " us, max " << m_maxNs / 1000.0 << " us" << std::endl;
+
+        for (int bucket = 0; bucket < 64; ++bucket) {
+            if (m_buckets[bucket] != 0) {
+                std::cout << "  < " << (uint64_t(2) << bucket) / 1000.0 << " us\t" << m_buckets[bucket] << std::endl;
+            }
+        }
+    }
+
+private:
+    uint64_t m_buckets[64];
+    uint64_t m_count;
+    uint64_t m_maxNs;
+};
+
+static uint64_t contentHash(const char* data, size_t size) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    for (; i < size; ++i) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static int bench(size_t stateMB, int saves) {
+    size_t size = std::max<size_t>(stateMB, 1) << 20;
+    Originator originator(size);
+    std::default_random_engine engine;
+
+    //写入随机的初始状态
+    std::vector<char> block(1 << 20);
+
+    for (auto& c : block) {
+        c = (char)engine();
+    }
+
+    for (size_t offset = 0; offset < size; offset += block.size()) {
+        originator.write(offset, block.data(), block.size());
+    }
+
+    const size_t recordSize = 64;
+    std::uniform_int_distribution<size_t> pick(0, size - recordSize);
+    char record[recordSize] = {};
+    uint64_t written = 0;
+    PauseHistogram writes;
+
+    auto mutate = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(record, &++written, sizeof(written));
+            size_t offset = pick(engine);
+
+            auto start = std::chrono::steady_clock::now();
+            originator.write(offset, record, recordSize);
+            writes.record(std::chrono::steady_clock::now() - start);
+        }
+    };
+
+    PauseHistogram pauses;
+    bool ok = true;
+    uint64_t duringSnapshots = 0;
+
+    for (int i = 0; i < saves; ++i) {
+        mutate(100000);
+        uint64_t expected = contentHash(originator.getData().data(), size);
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<Memento> memento = originator.saveStateToMemento();
+        pauses.record(std::chrono::steady_clock::now() - start);
+
+        //快照进行期间继续写
+        while (!memento->isReady()) {
+            mutate(1000);
+            duringSnapshots += 1000;
+        }
+
+        ok = ok && contentHash(memento->getData(), memento->getSize()) == expected;
+    }
+
+    PauseHistogram copies;
+
+    for (int i = 0; i < std::min(saves, 3); ++i) {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<Memento> memento = std::make_shared<Memento>(originator.getState());
+        copies.record(std::chrono::steady_clock::now() - start);
+    }
+
+    std::cout << "state: " << stateMB << " MB, saves: " << saves << ", writes during snapshots: " << duringSnapshots <<
+              std::endl;
+    pauses.print("background snapshot pause");
+    writes.print("write latency");
+    copies.print("synchronous copy pause");
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 512, argc > 3 ? std::stoi(argv[3]) : 10);
+    }
+
+    std::shared_ptr<Originator> originator = std::make_shared<Originator>(8, 4);
+    std::vector<std::shared_ptr<Memento>> mementoList;
+
+    originator->setState("State #1");
+    originator->setState("State #2");
+    mementoList.push_back(originator->saveStateToMemento());
+    //快照可能还没有完成，写入不会影响它
+    originator->setState("State #3");
+    mementoList.push_back(originator->saveStateToMemento());
+    originator->setState("State #4");
+
+    std::cout << "Current State: " << originator->getState() << std::endl;
+
+    originator->getStateFromMemento(mementoList[0]);
+    std::cout << "First saved State: " << originator->getState() << std::endl;
+
+    originator->getStateFromMemento(mementoList[1]);
+    std::cout << "Second saved State: " << originator->getState() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,488 @@
+/**
+ * 备忘录模式（Memento Pattern）的增量快照
+ *
+ * memento.cpp 中每次 saveStateToMemento 都把整个 m_state 复制到一个新的 Memento，
+ * CareTaker 用 std::vector<std::shared_ptr<Memento>> 全部保存。状态很大、两次保存之间只改动一点时，
+ * 绝大部分内存都花在重复的内容上。
+ *
+ * 这里的 CareTaker 不保存 Memento 本身，而是保存：
+ *      1、关键帧（keyframe）：完整的状态，每隔 keyframeInterval 次保存一个，
+ *         或者增量比状态的一半还大时也直接保存完整状态。
+ *      2、增量（delta）：相对上一次保存的状态的二进制差异。先去掉公共前缀和公共后缀，
+ *         中间部分长度不变时按字节比较，只记录变化的片段；长度变化时整体替换。
+ *      3、去重：按内容哈希查找完全相同的已保存状态，找到后只记录一个引用。
+ * get(index) 从最近的关键帧开始依次应用增量，最多应用 keyframeInterval - 1 个；
+ * 上一次重建的结果会被缓存，按顺序访问时只需要应用一个增量。
+ * getStats() 报告原始大小与实际占用的内存。
+ *
+ * 运行 `memento_delta bench [saves] [stateKB]` 输出保存与读取的耗时以及节省的内存。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Memento {
+public:
+    Memento(std::string state) {
+        m_state = state;
+    }
+
+    std::string getState() const {
+        return m_state;
+    }
+
+private:
+    std::string m_state;
+};
+
+class Originator {
+public:
+    void setState(std::string state) {
+        m_state = state;
+    }
+
+    std::string getState() const {
+        return m_state;
+    }
+
+    std::shared_ptr<Memento> saveStateToMemento() {
+        return std::make_shared<Memento>(m_state);
+    }
+
+    void getStateFromMemento(std::shared_ptr<Memento> memento) {
+        m_state = memento->getState();
+    }
+
+private:
+    std::string m_state;
+};
+
+static uint64_t contentHash(const std::string& data) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ data.size();
+    size_t i = 0;
+
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    for (; i < data.size(); ++i) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+//二进制增量：由 COPY（从基准复制）、SKIP（跳过基准）、ADD（追加字面量）组成
+class Delta {
+public:
+    //计算把 base 变成 target 的增量
+    static std::string encode(const std::string& base, const std::string& target) {
+        std::string out;
+        size_t prefix = 0;
+        size_t limit = std::min(base.size(), target.size());
+
+        while (prefix < limit && base[prefix] == target[prefix]) {
+            ++prefix;
+        }
+
+        size_t suffix = 0;
+
+        while (suffix < limit - prefix && base[base.size() - 1 - suffix] == target[target.size() - 1 - suffix]) {
+            ++suffix;
+        }
+
+        emit(out, Copy, prefix);
+        size_t baseMiddle = base.size() - prefix - suffix;
+        size_t targetMiddle = target.size() - prefix - suffix;
+
+        if (baseMiddle != targetMiddle) {
+            emit(out, Skip, baseMiddle);
+            emitAdd(out, target.data() + prefix, targetMiddle);
+        } else {
+            //长度相同：相等的片段复制，不同的片段替换；间隔很短的两个不同片段合并，减少操作数
+            const size_t gap = 8;
+            size_t i = prefix;
+            size_t end = prefix + targetMiddle;
+
+            while (i < end) {
+                size_t same = i;
+
+                while (same < end && base[same] == target[same]) {
+                    ++same;
+                }
+
+                emit(out, Copy, same - i);
+                size_t changed = same;
+                size_t run = same;
+
+                while (run < end) {
+                    if (base[run] != target[run]) {
+                        changed = ++run;
+                    } else if (run - changed < gap) {
+                        ++run;
+                    } else {
+                        break;
+                    }
+                }
+
+                emit(out, Skip, changed - same);
+                emitAdd(out, target.data() + same, changed - same);
+                i = changed;
+            }
+        }
+
+        emit(out, Copy, suffix);
+        return out;
+    }
+
+    //结果写入 out，复用它的容量
+    static void apply(const std::string& base, const std::string& delta, std::string& out) {
+        out.clear();
+        out.reserve(base.size());
+        size_t cursor = 0;
+        size_t p = 0;
+
+        while (p < delta.size()) {
+            uint64_t header = readVarint(delta, p);
+            size_t length = header >> 2;
+
+            switch (header & 3) {
+            case Copy:
+                out.append(base, cursor, length);
+                cursor += length;
+                break;
+
+            case Skip:
+                cursor += length;
+                break;
+
+            case Add:
+                out.append(delta, p, length);
+                p += length;
+                break;
+            }
+        }
+    }
+
+private:
+    enum Operation {
+        Copy,
+        Skip,
+        Add
+    };
+
+    static void emit(std::string& out, Operation operation, size_t length) {
+        if (length == 0) {
+            return;
+        }
+
+        uint64_t header = (uint64_t(length) << 2) | operation;
+
+        while (header >= 0x80) {
+            out.push_back(char(header | 0x80));
+            header >>= 7;
+        }
+
+        out.push_back(char(header));
+    }
+
+    static void emitAdd(std::string& out, const char* data, size_t length) {
+        emit(out, Add, length);
+        out.append(data, length);
+    }
+
+    static uint64_t readVarint(const std::string& data, size_t& p) {
+        uint64_t value = 0;
+        int shift = 0;
+
+        while (true) {
+            unsigned char byte = data[p++];
+            value |= uint64_t(byte & 0x7f) << shift;
+
+            if (byte < 0x80) {
+                return value;
+            }
+
+            shift += 7;
+        }
+    }
+};
+
+struct SnapshotStats {
+    size_t saves;
+    size_t keyframes;
+    size_t deltas;
+    size_t duplicates;
+    //所有保存的状态按原样存放需要的字节数
+    size_t logicalBytes;
+    //关键帧、增量与索引实际占用的字节数（不含最后一个状态的工作副本）
+    size_t storedBytes;
+};
+
+class CareTaker {
+public:
+    CareTaker(size_t keyframeInterval = 32) : m_keyframeInterval(std::max<size_t>(keyframeInterval, 1)),
+        m_logicalBytes(0), m_cachedIndex(-1) {}
+
+    void add(std::shared_ptr<Memento> memento) {
+        std::string state = memento->getState();
+        uint64_t hash = contentHash(state);
+        int index = (int)m_entries.size();
+        Entry entry = {Keyframe, hash, 0, 0, 0};
+        m_logicalBytes += state.size();
+
+        //哈希相同时重建比较一次，防止碰撞
+        auto range = m_byHash.equal_range(hash);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (reconstruct(it->second) == state) {
+                entry.kind = Duplicate;
+                entry.target = it->second;
+                entry.depth = m_entries[it->second].depth;
+                break;
+            }
+        }
+
+        if (entry.kind != Duplicate) {
+            std::string delta;
+
+            //前一个保存可能是指向更早保存的 Duplicate，按它实际的链长判断
+            if (index > 0 && m_entries.back().depth + 1 < m_keyframeInterval) {
+                delta = Delta::encode(m_last, state);
+            }
+
+            if (!delta.empty() && delta.size() < state.size() / 2) {
+                entry.kind = Incremental;
+                entry.blob = m_blobs.size();
+                m_blobs.push_back(delta);
+                entry.depth = m_entries.back().depth + 1;
+            } else {
+                entry.blob = m_blobs.size();
+                m_blobs.push_back(state);
+            }
+
+            m_byHash.insert(std::make_pair(hash, index));
+        }
+
+        m_entries.push_back(entry);
+        m_last.swap(state);
+    }
+
+    std::shared_ptr<Memento> get(int index) {
+        return std::make_shared<Memento>(reconstruct(index));
+    }
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+    SnapshotStats getStats() const {
+        SnapshotStats stats = {m_entries.size(), 0, 0, 0, m_logicalBytes, 0};
+
+        for (auto& entry : m_entries) {
+            if (entry.kind == Keyframe) {
+                ++stats.keyframes;
+            } else if (entry.kind == Incremental) {
+                ++stats.deltas;
+            } else {
+                ++stats.duplicates;
+            }
+        }
+
+        for (auto& blob : m_blobs) {
+            stats.storedBytes += blob.capacity() + sizeof(std::string);
+        }
+
+        stats.storedBytes += m_entries.capacity() * sizeof(Entry) + m_byHash.size() * (sizeof(uint64_t) + sizeof(int) +
+                             2 * sizeof(void*));
+        return stats;
+    }
+
+private:
+    enum Kind {
+        Keyframe,
+        Incremental,
+        Duplicate
+    };
+
+    struct Entry {
+        Kind kind;
+        uint64_t hash;
+        //Keyframe/Incremental 的数据在 m_blobs 中的位置
+        size_t blob;
+        //Duplicate 指向的保存
+        int target;
+        //重建时要应用的增量个数（经过 Duplicate 计算），小于 keyframeInterval
+        size_t depth;
+    };
+
+    const std::string& reconstruct(int index) {
+        if (index == m_cachedIndex) {
+            return m_cached;
+        }
+
+        //Incremental 的基准是前一个保存，Duplicate 等同于它指向的保存
+        std::vector<int> chain;
+        int current = index;
+
+        while (true) {
+            if (current == m_cachedIndex) {
+                break;
+            }
+
+            const Entry& entry = m_entries[current];
+
+            if (entry.kind == Duplicate) {
+                current = entry.target;
+            } else if (entry.kind == Keyframe) {
+                m_cached = m_blobs[entry.blob];
+                break;
+            } else {
+                chain.push_back(current);
+                --current;
+            }
+        }
+
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            Delta::apply(m_cached, m_blobs[m_entries[*it].blob], m_scratch);
+            m_cached.swap(m_scratch);
+        }
+
+        m_cachedIndex = index;
+        return m_cached;
+    }
+
+    size_t m_keyframeInterval;
+    size_t m_logicalBytes;
+    std::vector<Entry> m_entries;
+    std::vector<std::string> m_blobs;
+    std::unordered_multimap<uint64_t, int> m_byHash;
+    //最近一次保存的状态，用于计算下一个增量
+    std::string m_last;
+    int m_cachedIndex;
+    std::string m_cached;
+    std::string m_scratch;
+};
+
+static int bench(size_t saves, size_t stateKB) {
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::string state(stateKB * 1024, '\0');
+
+    for (auto& c : state) {
+        c = (char)byte(engine);
+    }
+
+    std::uniform_int_distribution<size_t> offset(0, state.size() - 64);
+    Originator originator;
+    CareTaker careTaker;
+    std::vector<uint64_t> expected;
+    std::string checkpoint = state;
+    double saveMs = 0;
+
+    for (size_t i = 0; i < saves; ++i) {
+        if (i % 10 == 9) {
+            //回到之前的某个状态，可以去重
+            state = checkpoint;
+        } else {
+            for (int edit = 0; edit < 8; ++edit) {
+                size_t at = offset(engine);
+
+                for (int k = 0; k < 16; ++k) {
+                    state[at + k] = (char)byte(engine);
+                }
+            }
+
+            if (i % 50 == 0) {
+                checkpoint = state;
+            }
+        }
+
+        originator.setState(state);
+        expected.push_back(contentHash(state));
+
+        auto start = std::chrono::steady_clock::now();
+        careTaker.add(originator.saveStateToMemento());
+        saveMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < saves; ++i) {
+        originator.getStateFromMemento(careTaker.get((int)i));
+        ok = ok && contentHash(originator.getState()) == expected[i];
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+    std::uniform_int_distribution<int> index(0, (int)saves - 1);
+
+    for (size_t i = 0; i < saves; ++i) {
+        int k = index(engine);
+        originator.getStateFromMemento(careTaker.get(k));
+        ok = ok && contentHash(originator.getState()) == expected[k];
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    SnapshotStats stats = careTaker.getStats();
+
+    std::cout << "saves: " << saves << ", state: " << stateKB << " KB" << std::endl;
+    std::cout << "keyframes: " << stats.keyframes << ", deltas: " << stats.deltas << ", duplicates: " <<
+              stats.duplicates << std::endl;
+    std::cout << "save: " << saveMs * 1000 / saves << " us per save" << std::endl;
+    std::cout << "get in order: " << std::chrono::duration<double, std::micro>(middle - start).count() / saves <<
+              " us, random: " << std::chrono::duration<double, std::micro>(end - middle).count() / saves << " us" <<
+              std::endl;
+    std::cout << "full copies: " << stats.logicalBytes / double(1 << 20) << " MB, stored: " << stats.storedBytes /
+              double(1 << 20) << " MB (" << 100.0 * stats.storedBytes / stats.logicalBytes << "%)" << std::endl;
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000, argc > 3 ? std::stoul(argv[3]) : 1024);
+    }
+
+    std::shared_ptr<Originator> originator = std::make_shared<Originator>();
+    std::shared_ptr<CareTaker> careTaker = std::make_shared<CareTaker>();
+
+    originator->setState("State #1");
+    originator->setState("State #2");
+    careTaker->add(originator->saveStateToMemento());
+    originator->setState("State #3");
+    careTaker->add(originator->saveStateToMemento());
+    originator->setState("State #2");
+    careTaker->add(originator->saveStateToMemento());
+    originator->setState("State #4");
+
+    std::cout << "Current State: " << originator->getState() << std::endl;
+
+    originator->getStateFromMemento(careTaker->get(0));
+    std::cout << "First saved State: " << originator->getState() << std::endl;
+
+    originator->getStateFromMemento(careTaker->get(1));
+    std::cout << "Second saved State: " << originator->getState() << std::endl;
+
+    originator->getStateFromMemento(careTaker->get(2));
+    std::cout << "Third saved State: " << originator->getState() << std::endl;
+
+    SnapshotStats stats = careTaker->getStats();
+    std::cout << "keyframes: " << stats.keyframes << ", deltas: " << stats.deltas << ", duplicates: " <<
+              stats.duplicates << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,549 @@
+/**
+ * 备忘录模式（Memento Pattern）的有界 CareTaker
+ *
+ * memento.cpp 中 CareTaker::m_mementoList 只增不减，长时间运行、频繁保存的进程最终会耗尽内存。
+ *
+ * 这里的 CareTaker 只在内存中保存最近的 resident 个快照（环形缓冲区），其余的按保留策略处理：
+ *      1、溢出：被挤出环形缓冲区的快照追加写入一个溢出文件，内存中只留下编号、时间、偏移和长度。
+ *         get(index) 读取旧快照时按需 mmap 整个文件，映射的页可以被内核随时回收。
+ *      2、保留最近 N 次（lastCount）：更早的保存直接丢弃。
+ *      3、保留最近 T 秒（lastSeconds）：更早的保存直接丢弃，要求保存时间单调递增。
+ *      4、指数稀疏（thinning）：年龄在 [2^k, 2^(k+1)) * resident 次保存之间的快照只保留编号是 2^k 倍数的，
+ *         每个区间大约保留 resident 个，总数随保存次数对数增长。
+ * 丢弃的快照 get 返回空指针。溢出文件中失效的字节超过有效字节时，把有效的快照重写到新文件（压缩）。
+ * 溢出文件只是 CareTaker 的扩展内存，不用于恢复，析构时删除。
+ *
+ * 运行 `memento_spill bench [saves] [stateBytes] [path]` 输出两种策略下的耗时、内存和文件大小，并校验所有快照。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class Memento {
+public:
+    Memento(std::string state) {
+        m_state = state;
+    }
+
+    std::string getState() const {
+        return m_state;
+    }
+
+    size_t getSize() const {
+        return m_state.size();
+    }
+
+private:
+    std::string m_state;
+};
+
+class Originator {
+public:
+    void setState(std::string state) {
+        m_state = state;
+    }
+
+    std::string getState() const {
+        return m_state;
+    }
+
+    std::shared_ptr<Memento> saveStateToMemento() {
+        return std::make_shared<Memento>(m_state);
+    }
+
+    void getStateFromMemento(std::shared_ptr<Memento> memento) {
+        m_state = memento->getState();
+    }
+
+private:
+    std::string m_state;
+};
+
+static std::runtime_error systemError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+//从 offset 处写入，失败时不改变文件位置，已经写入的部分留在文件末尾之外，之后会被覆盖
+static void writeAll(int fd, const char* data, size_t size, uint64_t offset, const std::string& path) {
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, offset);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw systemError("write", path);
+        }
+
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+struct RetentionPolicy {
+    RetentionPolicy() : resident(1024), lastCount(0), lastSeconds(0), thinning(false) {}
+
+    //内存中最多保存的快照数
+    size_t resident;
+    //只保留最近 lastCount 次保存，0 表示不限
+    size_t lastCount;
+    //只保留最近 lastSeconds 秒内的保存，0 表示不限
+    double lastSeconds;
+    //指数稀疏溢出的快照
+    bool thinning;
+};
+
+struct RetentionStats {
+    size_t saves;
+    size_t resident;
+    size_t spilled;
+    size_t dropped;
+    //内存中快照的状态字节数
+    size_t residentBytes;
+    uint64_t fileBytes;
+};
+
+class CareTaker {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    CareTaker(const std::string& path, const RetentionPolicy& policy = RetentionPolicy()) : m_path(path),
+        m_policy(policy), m_ring(std::max<size_t>(policy.resident, 1)), m_first(0), m_next(0), m_residentBytes(0),
+        m_fileSize(0), m_deadBytes(0), m_data(nullptr), m_mapped(0) {
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (m_fd < 0) {
+            throw systemError("open", path);
+        }
+    }
+
+    CareTaker(const CareTaker&) = delete;
+    CareTaker& operator=(const CareTaker&) = delete;
+
+    ~CareTaker() {
+        unmap();
+        ::close(m_fd);
+        unlink(m_path.c_str());
+    }
+
+    void add(std::shared_ptr<Memento> memento) {
+        add(memento, Clock::now());
+    }
+
+    void add(std::shared_ptr<Memento> memento, Clock::time_point time) {
+        Slot& slot = m_ring[m_next % m_ring.size()];
+
+        //被挤出的快照没有被丢弃时写入溢出文件
+        if (slot.memento != nullptr) {
+            spill(m_next - (int)m_ring.size(), slot);
+        }
+
+        slot.memento = memento;
+        slot.time = time;
+        m_residentBytes += memento->getSize();
+        ++m_next;
+        retain(time);
+    }
+
+    std::shared_ptr<Memento> get(int index) {
+        if (index < m_first || index >= m_next) {
+            return nullptr;
+        }
+
+        if (index >= getResidentBegin()) {
+            return m_ring[index % m_ring.size()].memento;
+        }
+
+        auto it = std::lower_bound(m_spilled.begin(), m_spilled.end(), index, [](const Spilled& spilled, int i) {
+            return spilled.index < i;
+        });
+
+        if (it == m_spilled.end() || it->index != index) {
+            return nullptr;
+        }
+
+        if (it->offset + it->length > m_mapped) {
+            map();
+        }
+
+        const char* data = m_data + it->offset;
+        return std::make_shared<Memento>(std::string(data, data + it->length));
+    }
+
+    size_t size() const {
+        return m_next;
+    }
+
+    RetentionStats getStats() const {
+        size_t resident = 0;
+
+        for (auto& slot : m_ring) {
+            resident += slot.memento != nullptr;
+        }
+
+        RetentionStats stats = {(size_t)m_next, resident, m_spilled.size(), m_next - resident - m_spilled.size(),
+                                m_residentBytes, m_fileSize
+                               };
+        return stats;
+    }
+
+private:
+    struct Slot {
+        std::shared_ptr<Memento> memento;
+        Clock::time_point time;
+    };
+
+    struct Spilled {
+        int index;
+        Clock::time_point time;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    //编号不小于它的保存在环形缓冲区中
+    int getResidentBegin() const {
+        return std::max(m_next - (int)m_ring.size(), 0);
+    }
+
+    void spill(int index, Slot& slot) {
+        std::string state = slot.memento->getState();
+        writeAll(m_fd, state.data(), state.size(), m_fileSize, m_path);
+
+        Spilled spilled = {index, slot.time, m_fileSize, state.size()};
+        m_spilled.push_back(spilled);
+        m_fileSize += state.size();
+        release(slot);
+    }
+
+    void release(Slot& slot) {
+        m_residentBytes -= slot.memento->getSize();
+        slot.memento.reset();
+    }
+
+    void retain(Clock::time_point now) {
+        int first = m_first;
+
+        if (m_policy.lastCount > 0 && (size_t)(m_next - first) > m_policy.lastCount) {
+            first = m_next - (int)m_policy.lastCount;
+        }
+
+        if (m_policy.lastSeconds > 0) {
+            Clock::time_point cutoff = now - std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>(m_policy.lastSeconds));
+            bool expired = true;
+
+            //溢出的快照都比内存中的旧
+            for (auto& spilled : m_spilled) {
+                if (spilled.index < first) {
+                    continue;
+                }
+
+                if (spilled.time >= cutoff) {
+                    expired = false;
+                    break;
+                }
+
+                first = spilled.index + 1;
+            }
+
+            if (expired) {
+                first = std::max(first, getResidentBegin());
+
+                while (first < m_next && m_ring[first % m_ring.size()].time < cutoff) {
+                    ++first;
+                }
+            }
+        }
+
+        drop(first);
+
+        if (m_policy.thinning && m_next % m_ring.size() == 0) {
+            thin();
+        }
+
+        if (m_deadBytes > m_fileSize - m_deadBytes) {
+            compact();
+        }
+    }
+
+    //丢弃编号小于 first 的保存
+    void drop(int first) {
+        while (!m_spilled.empty() && m_spilled.front().index < first) {
+            m_deadBytes += m_spilled.front().length;
+            m_spilled.pop_front();
+        }
+
+        for (int i = std::max(m_first, getResidentBegin()); i < first; ++i) {
+            release(m_ring[i % m_ring.size()]);
+        }
+
+        m_first = std::max(m_first, first);
+    }
+
+    void thin() {
+        int newest = m_next - 1;
+        auto out = m_spilled.begin();
+
+        for (auto& spilled : m_spilled) {
+            //溢出的快照年龄至少是 resident 次保存
+            int age = (newest - spilled.index) / (int)m_ring.size();
+            int step = 1;
+
+            while (step <= age / 2) {
+                step *= 2;
+            }
+
+            if (spilled.index % step == 0) {
+                *out++ = spilled;
+            } else {
+                m_deadBytes += spilled.length;
+            }
+        }
+
+        m_spilled.erase(out, m_spilled.end());
+    }
+
+    //把有效的快照按顺序重写到新文件
+    void compact() {
+        if (m_mapped < m_fileSize) {
+            map();
+        }
+
+        std::string path = m_path + ".compact";
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0) {
+            throw systemError("open", path);
+        }
+
+        //全部写完并替换原文件之后才修改偏移，失败时原文件和索引保持不变
+        std::vector<uint64_t> offsets;
+        offsets.reserve(m_spilled.size());
+        uint64_t offset = 0;
+
+        try {
+            for (auto& spilled : m_spilled) {
+                writeAll(fd, m_data + spilled.offset, spilled.length, offset, path);
+                offsets.push_back(offset);
+                offset += spilled.length;
+            }
+
+            if (rename(path.c_str(), m_path.c_str()) != 0) {
+                throw systemError("rename", path);
+            }
+        } catch (...) {
+            ::close(fd);
+            unlink(path.c_str());
+            throw;
+        }
+
+        for (size_t i = 0; i < m_spilled.size(); ++i) {
+            m_spilled[i].offset = offsets[i];
+        }
+
+        unmap();
+        ::close(m_fd);
+        m_fd = fd;
+        m_fileSize = offset;
+        m_deadBytes = 0;
+    }
+
+    //映射当前整个文件
+    void map() {
+        unmap();
+
+        if (m_fileSize == 0) {
+            return;
+        }
+
+        void* data = mmap(nullptr, m_fileSize, PROT_READ, MAP_SHARED, m_fd, 0);
+
+        if (data == MAP_FAILED) {
+            throw systemError("mmap", m_path);
+        }
+
+        m_data = static_cast<const char*>(data);
+        m_mapped = m_fileSize;
+    }
+
+    void unmap() {
+        if (m_data != nullptr) {
+            munmap(const_cast<char*>(m_data), m_mapped);
+            m_data = nullptr;
+            m_mapped = 0;
+        }
+    }
+
+    std::string m_path;
+    RetentionPolicy m_policy;
+    std::vector<Slot> m_ring;
+    //按编号排序
+    std::deque<Spilled> m_spilled;
+    //编号小于 m_first 的保存已经被丢弃
+    int m_first;
+    int m_next;
+    size_t m_residentBytes;
+    uint64_t m_fileSize;
+    uint64_t m_deadBytes;
+    int m_fd;
+    const char* m_data;
+    uint64_t m_mapped;
+};
+
+static size_t residentKB() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+
+    if (file != nullptr) {
+        if (std::fscanf(file, "%lu %lu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+
+        std::fclose(file);
+    }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void printStats(const RetentionStats& stats) {
+    std::cout << "saves: " << stats.saves << ", resident: " << stats.resident << ", spilled: " << stats.spilled <<
+              ", dropped: " << stats.dropped << ", resident state: " << stats.residentBytes / 1024 << " KB, file: " <<
+              stats.fileBytes / 1024 << " KB" << std::endl;
+}
+
+//第 index 次保存的状态：前 8 个字节是编号，其余与 base 相同
+static std::string makeState(const std::string& base, int index) {
+    std::string state = base;
+    std::memcpy(&state[0], &index, sizeof(index));
+    return state;
+}
+
+static bool isState(const std::string& state, const std::string& base, int index) {
+    return state.size() == base.size() && std::memcmp(state.data(), &index, sizeof(index)) == 0 &&
+           state.compare(sizeof(index), std::string::npos, base, sizeof(index), std::string::npos) == 0;
+}
+
+static bool benchPolicy(const std::string& name, const RetentionPolicy& policy, int saves, const std::string& base,
+                        const std::string& path) {
+    size_t startKB = residentKB();
+    CareTaker careTaker(path, policy);
+    Originator originator;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < saves; ++i) {
+        originator.setState(makeState(base, i));
+        careTaker.add(originator.saveStateToMemento());
+    }
+
+    auto added = std::chrono::steady_clock::now();
+    size_t addKB = residentKB();
+    RetentionStats stats = careTaker.getStats();
+    bool ok = stats.resident == std::min<size_t>(saves, policy.resident);
+    size_t kept = 0;
+
+    for (int i = 0; i < saves; ++i) {
+        std::shared_ptr<Memento> memento = careTaker.get(i);
+
+        if (memento != nullptr) {
+            ok = ok && isState(memento->getState(), base, i);
+            ++kept;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    ok = ok && kept == stats.resident + stats.spilled;
+
+    std::cout << name << ":" << std::endl;
+    printStats(stats);
+    std::cout << "add: " << std::chrono::duration<double, std::micro>(added - start).count() / saves << " us per save, "
+              "RSS +" << addKB - startKB << " KB (unbounded CareTaker: " << (double)saves * base.size() / (1 << 20) <<
+              " MB)" << std::endl;
+    std::cout << "get all " << kept << " kept: " << std::chrono::duration<double, std::micro>(end - added).count() /
+              kept << " us each" << std::endl;
+
+    return ok;
+}
+
+static int bench(int saves, size_t stateBytes, const std::string& path) {
+    std::default_random_engine engine;
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::string base(std::max(stateBytes, sizeof(int)), '\0');
+
+    for (auto& c : base) {
+        c = (char)byte(engine);
+    }
+
+    RetentionPolicy thinning;
+    thinning.thinning = true;
+    RetentionPolicy last;
+    last.lastCount = std::max(saves / 10, 1);
+
+    bool ok = benchPolicy("exponential thinning", thinning, saves, base, path);
+    ok = benchPolicy("last " + std::to_string(last.lastCount), last, saves, base, path) && ok;
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoi(argv[2]) : 100000, argc > 3 ? std::stoul(argv[3]) : 8192,
+                     argc > 4 ? argv[4] : "memento_spill.bench.dat");
+    }
+
+    std::shared_ptr<Originator> originator = std::make_shared<Originator>();
+    RetentionPolicy policy;
+    policy.resident = 2;
+    policy.lastCount = 4;
+    CareTaker careTaker("memento_spill.demo.dat", policy);
+
+    for (int i = 1; i <= 6; ++i) {
+        originator->setState("State #" + std::to_string(i));
+        careTaker.add(originator->saveStateToMemento());
+    }
+
+    std::cout << "Current State: " << originator->getState() << std::endl;
+
+    for (int i = 0; i < (int)careTaker.size(); ++i) {
+        std::shared_ptr<Memento> memento = careTaker.get(i);
+        std::cout << "Saved State " << i << ": " << (memento != nullptr ? memento->getState() : "(dropped)") << std::endl;
+    }
+
+    printStats(careTaker.getStats());
+
+    //只保留最近 10 秒
+    policy.lastCount = 0;
+    policy.lastSeconds = 10;
+    CareTaker recent("memento_spill.recent.dat", policy);
+    CareTaker::Clock::time_point now = CareTaker::Clock::now();
+
+    for (int i = 3; i >= 0; --i) {
+        originator->setState("State at -" + std::to_string(i * 5) + "s");
+        recent.add(originator->saveStateToMemento(), now - std::chrono::seconds(i * 5));
+    }
+
+    for (int i = 0; i < (int)recent.size(); ++i) {
+        std::shared_ptr<Memento> memento = recent.get(i);
+        std::cout << "Recent State " << i << ": " << (memento != nullptr ? memento->getState() : "(dropped)") << std::endl;
+    }
+
+    return 0;
+}
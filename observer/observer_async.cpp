@@ -0,0 +1,554 @@
+/**
+ * 观察者模式（Observer Pattern）的异步通知
+ *
+ * observer.cpp 中 Subject::setState 在调用线程里依次执行每个观察者的 update()，
+ * 一个慢的观察者（比如要写 std::cout 的 BinaryObserver）会拖住修改状态的一方。
+ *
+ * 这里的 AsyncSubject 为每个观察者建一个有界队列（Mailbox），setState 只把新状态放进队列就返回，
+ * 由后台工作线程取出并调用 update(state)。同一个观察者的队列固定由一个工作线程处理，保证投递顺序。
+ * 每个观察者可以单独配置：
+ *      1、capacity：队列容量。
+ *      2、policy：队列满时的背压策略。
+ *              Block       阻塞 setState，直到观察者处理掉一个状态。
+ *              DropOldest  丢弃队列中最旧的状态。
+ *              Conflate    用新状态覆盖队列中最新的一个状态。
+ *      3、coalesce：投递时合并积压，只把队列中最新的状态交给观察者，适合只关心当前值的观察者。
+ * 每个观察者记录投递指标：发布/投递/丢弃/合并的次数、队列深度、从 setState 到开始投递的延迟（按 2 的幂分桶）。
+ * 多个线程同时 setState 时按写入 m_state 的顺序入队，观察者最后收到的状态与 getState() 相同。
+ * 观察者的 update 中不能调用 setState，否则 Block 策略下会与正在等待它的 setState 互相等待。
+ *
+ * 运行 `observer_async bench [states]` 对比同步通知与三种背压策略下生产者的耗时和投递指标。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Observer {
+public:
+    virtual ~Observer() = default;
+    virtual void update(int state) = 0;
+};
+
+enum class BackpressurePolicy {
+    Block,
+    DropOldest,
+    Conflate
+};
+
+struct DispatchOptions {
+    DispatchOptions(size_t capacity = 64, BackpressurePolicy policy = BackpressurePolicy::Block,
+                    bool coalesce = false) : capacity(capacity), policy(policy), coalesce(coalesce) {}
+
+    size_t capacity;
+    BackpressurePolicy policy;
+    bool coalesce;
+};
+
+struct DeliveryMetrics {
+    DeliveryMetrics() : published(0), delivered(0), dropped(0), conflated(0), depth(0), maxDepth(0),
+        totalLatencyNs(0), maxLatencyNs(0) {
+        std::memset(histogram, 0, sizeof(histogram));
+    }
+
+    void recordLatency(uint64_t ns) {
+        totalLatencyNs += ns;
+        maxLatencyNs = std::max(maxLatencyNs, ns);
+        ++histogram[63 - __builtin_clzll(ns | 1)];
+    }
+
+    //p 分位的延迟上界（纳秒），精度为 2 倍
+    uint64_t percentile(double p) const {
+        uint64_t total = 0;
+
+        for (auto count : histogram) {
+            total += count;
+        }
+
+        uint64_t seen = 0;
+
+        for (int bucket = 0; bucket < 64; ++bucket) {
+            seen += histogram[bucket];
+
+            if (seen > 0 && seen >= total * p) {
+                return uint64_t(2) << bucket;
+            }
+        }
+
+        return 0;
+    }
+
+    uint64_t published;
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t conflated;
+    size_t depth;
+    size_t maxDepth;
+    uint64_t totalLatencyNs;
+    uint64_t maxLatencyNs;
+    //第 i 个桶记录 [2^i, 2^(i+1)) 纳秒的投递次数
+    uint64_t histogram[64];
+};
+
+class AsyncSubject {
+public:
+    AsyncSubject(size_t workers = 1) : m_state(0), m_targets(std::make_shared<std::vector<Mailbox*>>()) {
+        for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i) {
+            m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+
+        for (auto& worker : m_workers) {
+            worker->thread = std::thread(&AsyncSubject::run, worker.get());
+        }
+    }
+
+    //处理完已经入队的状态后再退出
+    ~AsyncSubject() {
+        for (auto& worker : m_workers) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stop = true;
+            worker->ready.notify_one();
+        }
+
+        for (auto& worker : m_workers) {
+            worker->thread.join();
+        }
+    }
+
+    AsyncSubject(const AsyncSubject&) = delete;
+    AsyncSubject& operator=(const AsyncSubject&) = delete;
+
+    int getState() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_state;
+    }
+
+    //m_publishMutex 保证写入顺序与入队顺序一致；Block 策略等待时不持有 m_mutex，
+    //观察者在 update 中可以调用 getState，其他线程可以 attach
+    void setState(int state) {
+        std::lock_guard<std::mutex> publishing(m_publishMutex);
+        Pending pending = {state, std::chrono::steady_clock::now()};
+        std::shared_ptr<const std::vector<Mailbox*>> targets;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_state = state;
+            targets = m_targets;
+        }
+
+        for (auto mailbox : *targets) {
+            push(*mailbox, pending);
+        }
+    }
+
+    //capacity 为 0 时按 1 处理
+    void attach(std::shared_ptr<Observer> observer, DispatchOptions options = DispatchOptions()) {
+        options.capacity = std::max<size_t>(options.capacity, 1);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Worker* worker = m_workers[m_mailboxes.size() % m_workers.size()].get();
+        m_mailboxes.push_back(std::unique_ptr<Mailbox>(new Mailbox(observer, options, worker)));
+
+        //setState 可能正在遍历旧的列表，复制一份再发布
+        std::shared_ptr<std::vector<Mailbox*>> targets = std::make_shared<std::vector<Mailbox*>>(*m_targets);
+        targets->push_back(m_mailboxes.back().get());
+        m_targets = targets;
+
+        std::lock_guard<std::mutex> workerLock(worker->mutex);
+        worker->mailboxes.push_back(m_mailboxes.back().get());
+    }
+
+    //等待所有已入队的状态投递完成
+    void flush() {
+        for (auto& worker : m_workers) {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            worker->drained.wait(lock, [&worker]() {
+                return worker->inFlight == 0 && !hasPending(*worker);
+            });
+        }
+    }
+
+    DeliveryMetrics getMetrics(std::shared_ptr<Observer> observer) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& mailbox : m_mailboxes) {
+            if (mailbox->observer == observer) {
+                std::lock_guard<std::mutex> workerLock(mailbox->worker->mutex);
+                return mailbox->metrics;
+            }
+        }
+
+        return DeliveryMetrics();
+    }
+
+private:
+    struct Pending {
+        int state;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    struct Worker;
+
+    struct Mailbox {
+        Mailbox(std::shared_ptr<Observer> observer, DispatchOptions options, Worker* worker) : observer(observer),
+            options(options), worker(worker) {}
+
+        std::shared_ptr<Observer> observer;
+        DispatchOptions options;
+        Worker* worker;
+        //以下成员由 worker->mutex 保护
+        std::deque<Pending> queue;
+        DeliveryMetrics metrics;
+    };
+
+    struct Worker {
+        Worker() : cursor(0), inFlight(0), stop(false) {}
+
+        std::mutex mutex;
+        //有新状态入队或需要退出
+        std::condition_variable ready;
+        //有状态出队或投递完成
+        std::condition_variable drained;
+        std::vector<Mailbox*> mailboxes;
+        size_t cursor;
+        size_t inFlight;
+        bool stop;
+        std::thread thread;
+    };
+
+    //在 m_mutex 之外调用，Block 策略会在这里等待
+    static void push(Mailbox& mailbox, const Pending& pending) {
+        Worker& worker = *mailbox.worker;
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        DeliveryMetrics& metrics = mailbox.metrics;
+        ++metrics.published;
+
+        if (mailbox.queue.size() >= mailbox.options.capacity) {
+            switch (mailbox.options.policy) {
+            case BackpressurePolicy::Block:
+                worker.drained.wait(lock, [&mailbox]() {
+                    return mailbox.queue.size() < mailbox.options.capacity;
+                });
+                break;
+
+            case BackpressurePolicy::DropOldest:
+                mailbox.queue.pop_front();
+                ++metrics.dropped;
+                break;
+
+            case BackpressurePolicy::Conflate:
+                mailbox.queue.back() = pending;
+                ++metrics.conflated;
+                return;
+            }
+        }
+
+        mailbox.queue.push_back(pending);
+        metrics.depth = mailbox.queue.size();
+        metrics.maxDepth = std::max(metrics.maxDepth, metrics.depth);
+        worker.ready.notify_one();
+    }
+
+    static bool hasPending(const Worker& worker) {
+        for (auto mailbox : worker.mailboxes) {
+            if (!mailbox->queue.empty()) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    //从上次的位置开始轮询，避免一个繁忙的观察者饿死其他观察者
+    static Mailbox* findReady(Worker& worker) {
+        size_t count = worker.mailboxes.size();
+
+        for (size_t i = 0; i < count; ++i) {
+            Mailbox* mailbox = worker.mailboxes[(worker.cursor + i) % count];
+
+            if (!mailbox->queue.empty()) {
+                worker.cursor = (worker.cursor + i + 1) % count;
+                return mailbox;
+            }
+        }
+
+        return nullptr;
+    }
+
+    static void run(Worker* worker) {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+
+        while (true) {
+            Mailbox* mailbox = findReady(*worker);
+
+            if (mailbox == nullptr) {
+                if (worker->stop) {
+                    break;
+                }
+
+                worker->ready.wait(lock);
+                continue;
+            }
+
+            DeliveryMetrics& metrics = mailbox->metrics;
+            Pending pending;
+
+            if (mailbox->options.coalesce) {
+                pending = mailbox->queue.back();
+                metrics.conflated += mailbox->queue.size() - 1;
+                mailbox->queue.clear();
+            } else {
+                pending = mailbox->queue.front();
+                mailbox->queue.pop_front();
+            }
+
+            metrics.depth = mailbox->queue.size();
+            metrics.recordLatency(std::chrono::duration_cast<std::chrono::nanoseconds>
+                                  (std::chrono::steady_clock::now() - pending.time).count());
+            ++worker->inFlight;
+            worker->drained.notify_all();
+
+            //调用观察者时不持有锁，setState 可以继续入队
+            lock.unlock();
+            mailbox->observer->update(pending.state);
+            lock.lock();
+
+            ++metrics.delivered;
+            --worker->inFlight;
+            worker->drained.notify_all();
+        }
+    }
+
+    //串行化 setState，从写入 m_state 一直持有到入队完成
+    std::mutex m_publishMutex;
+    //保护 m_state、m_mailboxes 与 m_targets
+    mutable std::mutex m_mutex;
+    int m_state;
+    std::vector<std::unique_ptr<Mailbox>> m_mailboxes;
+    //setState 使用的 m_mailboxes 快照，attach 时替换
+    std::shared_ptr<const std::vector<Mailbox*>> m_targets;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+class BinaryObserver: public Observer {
+public:
+    virtual void update(int state) override {
+        std::cout << "Binary String: " << std::bitset<32>(state) << std::endl;
+    }
+};
+
+class OctalObserver: public Observer {
+public:
+    virtual void update(int state) override {
+        std::cout << "Octal String: " << std::oct << state << std::dec << std::endl;
+    }
+};
+
+class HexaObserver: public Observer {
+public:
+    virtual void update(int state) override {
+        std::cout << "Hex String: " << std::hex << state << std::dec << std::endl;
+    }
+};
+
+//每次 update 耗时 delay 微秒，只由一个工作线程调用
+class SlowObserver: public Observer {
+public:
+    SlowObserver(int delay) : m_delay(delay), m_count(0), m_last(-1) {}
+
+    virtual void update(int state) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_delay));
+        ++m_count;
+        m_last = state;
+    }
+
+    size_t getCount() const {
+        return m_count;
+    }
+
+    int getLast() const {
+        return m_last;
+    }
+
+private:
+    int m_delay;
+    size_t m_count;
+    int m_last;
+};
+
+//两个生产者分别发布偶数与奇数状态，检查每个生产者的状态按顺序到达
+class OrderObserver: public Observer {
+public:
+    OrderObserver() : m_ordered(true), m_last(-1) {
+        m_lastByProducer[0] = -1;
+        m_lastByProducer[1] = -1;
+    }
+
+    virtual void update(int state) override {
+        int& last = m_lastByProducer[state % 2];
+        m_ordered = m_ordered && state > last;
+        last = state;
+        m_last = state;
+    }
+
+    bool isOrdered() const {
+        return m_ordered;
+    }
+
+    int getLast() const {
+        return m_last;
+    }
+
+private:
+    bool m_ordered;
+    int m_last;
+    int m_lastByProducer[2];
+};
+
+static void printMetrics(const std::string& name, const DeliveryMetrics& metrics) {
+    std::cout << name << ": published " << metrics.published << ", delivered " << metrics.delivered <<
+              ", dropped " << metrics.dropped << ", conflated " << metrics.conflated << ", max depth " <<
+              metrics.maxDepth << ", latency p50 < " << metrics.percentile(0.5) / 1000.0 << " us, p99 < " <<
+              metrics.percentile(0.99) / 1000.0 << " us, max " << metrics.maxLatencyNs / 1000.0 << " us" << std::endl;
+}
+
+static int bench(int states) {
+    const int delay = 50;
+    int failures = 0;
+
+    //同步通知：每次 setState 都要等慢观察者返回
+    SlowObserver inlineObserver(delay);
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < states; ++i) {
+        inlineObserver.update(i);
+    }
+
+    std::cout << "states: " << states << ", slow observer: " << delay << " us per update" << std::endl;
+    std::cout << "inline: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+              start).count() << " ms" << std::endl;
+
+    const char* names[] = {"block", "drop-oldest", "conflate", "drop-oldest + coalesce"};
+    DispatchOptions options[] = {
+        DispatchOptions(64, BackpressurePolicy::Block),
+        DispatchOptions(64, BackpressurePolicy::DropOldest),
+        DispatchOptions(64, BackpressurePolicy::Conflate),
+        DispatchOptions(64, BackpressurePolicy::DropOldest, true)
+    };
+
+    for (int i = 0; i < 4; ++i) {
+        AsyncSubject subject(2);
+        std::shared_ptr<SlowObserver> slow = std::make_shared<SlowObserver>(delay);
+        std::shared_ptr<SlowObserver> fast = std::make_shared<SlowObserver>(0);
+        subject.attach(slow, options[i]);
+        subject.attach(fast, options[i]);
+
+        start = std::chrono::steady_clock::now();
+
+        for (int state = 0; state < states; ++state) {
+            subject.setState(state);
+        }
+
+        auto produced = std::chrono::steady_clock::now();
+        subject.flush();
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << names[i] << ": producer " << std::chrono::duration<double, std::milli>(produced - start).count()
+                  << " ms, drained " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" <<
+                  std::endl;
+        printMetrics("    slow", subject.getMetrics(slow));
+        printMetrics("    fast", subject.getMetrics(fast));
+
+        //所有策略都必须投递最后一个状态，Block 必须投递全部状态
+        if (slow->getLast() != states - 1 || fast->getLast() != states - 1 ||
+                (options[i].policy == BackpressurePolicy::Block && slow->getCount() != (size_t)states)) {
+            std::cout << "    unexpected delivery" << std::endl;
+            ++failures;
+        }
+    }
+
+    //两个生产者同时 setState
+    for (int i = 0; i < 4; ++i) {
+        AsyncSubject subject(2);
+        std::shared_ptr<OrderObserver> first = std::make_shared<OrderObserver>();
+        std::shared_ptr<OrderObserver> second = std::make_shared<OrderObserver>();
+        subject.attach(first, options[i]);
+        subject.attach(second, DispatchOptions(4, options[i].policy, options[i].coalesce));
+
+        std::vector<std::thread> producers;
+
+        for (int producer = 0; producer < 2; ++producer) {
+            producers.push_back(std::thread([&subject, producer, states]() {
+                for (int state = producer; state < states; state += 2) {
+                    subject.setState(state);
+                }
+            }));
+        }
+
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        subject.flush();
+
+        if (!first->isOrdered() || !second->isOrdered() || first->getLast() != subject.getState() ||
+                second->getLast() != subject.getState()) {
+            std::cout << names[i] << ": two producers delivered out of order" << std::endl;
+            ++failures;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoi(argv[2]) : 10000);
+    }
+
+    std::shared_ptr<BinaryObserver> binaryObserver = std::make_shared<BinaryObserver>();
+    std::shared_ptr<OctalObserver> octalObserver = std::make_shared<OctalObserver>();
+    std::shared_ptr<HexaObserver> hexaObserver = std::make_shared<HexaObserver>();
+    std::shared_ptr<SlowObserver> slowObserver = std::make_shared<SlowObserver>(1000);
+
+    {
+        //只有一个工作线程，输出不会交错
+        AsyncSubject subject;
+        subject.attach(binaryObserver);
+        subject.attach(octalObserver);
+        subject.attach(hexaObserver);
+
+        std::cout << "First state change: 15" << std::endl;
+        subject.setState(15);
+        subject.flush();
+
+        std::cout << "Second state change: 10" << std::endl;
+        subject.setState(10);
+        subject.flush();
+    }
+
+    //状态变化比观察者快时只投递最新的状态
+    AsyncSubject subject;
+    subject.attach(slowObserver, DispatchOptions(1, BackpressurePolicy::Conflate));
+
+    for (int state = 0; state < 100; ++state) {
+        subject.setState(state);
+    }
+
+    subject.flush();
+    std::cout << "Slow observer received " << slowObserver->getCount() << " of 100 states, last state " <<
+              slowObserver->getLast() << std::endl;
+    printMetrics("slow", subject.getMetrics(slowObserver));
+
+    return 0;
+}
@@ -0,0 +1,418 @@
+/**
+ * 观察者模式（Observer Pattern）的并发 Subject
+ *
+ * observer.cpp 中的 Subject 用 std::list<std::shared_ptr<Observer>> 保存观察者，
+ * notifyAllObservers 按值复制每个 shared_ptr，每通知一个观察者就有两次原子的引用计数操作，
+ * 而且不能在其他线程中安全地 attach。
+ *
+ * 这里的 ConcurrentSubject 采用 RCU 的方式：
+ *      1、观察者列表是一个不可变的快照（数组），通过原子指针发布。
+ *      2、attach/detach 在互斥锁内复制一份新快照再替换指针，可以在任意线程、在通知进行中调用。
+ *      3、通知时只在开始和结束各登记一次读者纪元（epoch），之后就是普通的数组遍历，每个观察者没有原子操作。
+ *      4、被替换的旧快照挂到待回收列表上，等所有可能还在读它的读者都离开之后再释放（基于纪元的回收）。
+ *         每次 attach/detach 时回收已经安全的旧快照；synchronize() 等待当前的旧快照都被回收，
+ *         返回后被 detach 的观察者不会再被通知，旧快照持有的引用也已经释放。
+ *
+ * 运行 `observer_rcu bench` 对比逐个复制 shared_ptr 与遍历快照的通知耗时，并在通知的同时并发 attach/detach。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class Observer {
+public:
+    virtual ~Observer() = default;
+    virtual void update() = 0;
+};
+
+//进程内所有读者共用的纪元域：每个线程占用一个槽位，读的时候把当前纪元写进槽位，读完清零
+class EpochDomain {
+public:
+    static EpochDomain& getInstance() {
+        static EpochDomain instance;
+        return instance;
+    }
+
+    //进入读临界区，同一线程可以嵌套（观察者在 update 中再次触发通知）
+    void enter() {
+        ThreadState& state = getThreadState();
+
+        if (state.depth++ == 0) {
+            //seq_cst 写入，保证之后读取快照指针不会被重排到登记之前
+            m_slots[state.slot].epoch.store(m_epoch.load());
+        }
+    }
+
+    void exit() {
+        ThreadState& state = getThreadState();
+
+        if (--state.depth == 0) {
+            m_slots[state.slot].epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    //发布新指针之后调用，返回旧对象的退休纪元
+    uint64_t advance() {
+        return m_epoch.fetch_add(1);
+    }
+
+    //退休纪元为 epoch 的对象是否已经没有读者
+    bool isSafe(uint64_t epoch) const {
+        for (auto& slot : m_slots) {
+            uint64_t active = slot.epoch.load();
+
+            if (active != 0 && active <= epoch) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    static const size_t MaxThreads = 256;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> used;
+    };
+
+    struct ThreadState {
+        ThreadState(EpochDomain& domain) : domain(domain), slot(domain.acquireSlot()), depth(0) {}
+
+        ~ThreadState() {
+            domain.m_slots[slot].used.store(false);
+        }
+
+        EpochDomain& domain;
+        size_t slot;
+        int depth;
+    };
+
+    EpochDomain() : m_epoch(1) {
+        for (auto& slot : m_slots) {
+            slot.epoch.store(0);
+            slot.used.store(false);
+        }
+    }
+
+    ThreadState& getThreadState() {
+        static thread_local ThreadState state(*this);
+        return state;
+    }
+
+    size_t acquireSlot() {
+        for (size_t i = 0; i < MaxThreads; ++i) {
+            bool expected = false;
+
+            if (m_slots[i].used.compare_exchange_strong(expected, true)) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("EpochDomain: too many reader threads");
+    }
+
+    std::atomic<uint64_t> m_epoch;
+    Slot m_slots[MaxThreads];
+};
+
+class ConcurrentSubject {
+public:
+    ConcurrentSubject() : m_state(0), m_snapshot(new Snapshot()) {}
+
+    ~ConcurrentSubject() {
+        delete m_snapshot.load();
+
+        for (auto& retired : m_retired) {
+            delete retired.snapshot;
+        }
+    }
+
+    ConcurrentSubject(const ConcurrentSubject&) = delete;
+    ConcurrentSubject& operator=(const ConcurrentSubject&) = delete;
+
+    int getState() const {
+        return m_state.load(std::memory_order_relaxed);
+    }
+
+    void setState(int state) {
+        m_state.store(state, std::memory_order_relaxed);
+        notifyAllObservers();
+    }
+
+    void attach(std::shared_ptr<Observer> observer) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        Snapshot* snapshot = new Snapshot(*m_snapshot.load());
+        snapshot->observers.push_back(observer);
+        publish(snapshot);
+    }
+
+    //返回时仍在进行的通知可能还会调用这个观察者，需要确认时再调用 synchronize()
+    void detach(std::shared_ptr<Observer> observer) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        const Snapshot* current = m_snapshot.load();
+
+        if (std::find(current->observers.begin(), current->observers.end(), observer) == current->observers.end()) {
+            return;
+        }
+
+        Snapshot* snapshot = new Snapshot();
+
+        for (auto& other : current->observers) {
+            if (other != observer) {
+                snapshot->observers.push_back(other);
+            }
+        }
+
+        publish(snapshot);
+    }
+
+    //等待调用前被替换的旧快照都没有读者并释放它们，不能在 update 中调用
+    void synchronize() {
+        uint64_t target = 0;
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(m_writeMutex);
+
+                if (target == 0) {
+                    for (auto& retired : m_retired) {
+                        target = std::max(target, retired.epoch);
+                    }
+                }
+
+                reclaim();
+                bool pending = false;
+
+                for (auto& retired : m_retired) {
+                    pending = pending || retired.epoch <= target;
+                }
+
+                if (!pending) {
+                    return;
+                }
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    void notifyAllObservers() {
+        EpochDomain& domain = EpochDomain::getInstance();
+        domain.enter();
+        const Snapshot* snapshot = m_snapshot.load();
+
+        //按引用遍历，不复制 shared_ptr
+        for (const std::shared_ptr<Observer>& observer : snapshot->observers) {
+            observer->update();
+        }
+
+        domain.exit();
+    }
+
+private:
+    struct Snapshot {
+        std::vector<std::shared_ptr<Observer>> observers;
+    };
+
+    struct Retired {
+        Snapshot* snapshot;
+        uint64_t epoch;
+    };
+
+    //在 m_writeMutex 内调用
+    void publish(Snapshot* snapshot) {
+        Snapshot* old = m_snapshot.exchange(snapshot);
+        EpochDomain& domain = EpochDomain::getInstance();
+        Retired retired = {old, domain.advance()};
+        m_retired.push_back(retired);
+        reclaim();
+    }
+
+    //在 m_writeMutex 内调用，释放已经没有读者的旧快照
+    void reclaim() {
+        EpochDomain& domain = EpochDomain::getInstance();
+        size_t n = 0;
+
+        for (auto& item : m_retired) {
+            if (domain.isSafe(item.epoch)) {
+                delete item.snapshot;
+            } else {
+                m_retired[n++] = item;
+            }
+        }
+
+        m_retired.resize(n);
+    }
+
+    std::atomic<int> m_state;
+    std::atomic<Snapshot*> m_snapshot;
+    std::mutex m_writeMutex;
+    std::vector<Retired> m_retired;
+};
+
+class BinaryObserver: public Observer {
+public:
+    BinaryObserver(const ConcurrentSubject& subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::cout << "Binary String: " << std::bitset<32>(m_subject.getState()) << std::endl;
+    }
+private:
+    const ConcurrentSubject& m_subject;
+};
+
+class OctalObserver: public Observer {
+public:
+    OctalObserver(const ConcurrentSubject& subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::cout << "Octal String: " << std::oct << m_subject.getState() << std::endl;
+    }
+private:
+    const ConcurrentSubject& m_subject;
+};
+
+class HexaObserver: public Observer {
+public:
+    HexaObserver(const ConcurrentSubject& subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::cout << "Hex String: " << std::hex << m_subject.getState() << std::dec << std::endl;
+    }
+private:
+    const ConcurrentSubject& m_subject;
+};
+
+class CountingObserver: public Observer {
+public:
+    CountingObserver() : m_count(0) {}
+
+    virtual void update() override {
+        ++m_count;
+    }
+
+    size_t getCount() const {
+        return m_count;
+    }
+
+private:
+    size_t m_count;
+};
+
+static int bench() {
+    const size_t observerCount = 64;
+    const size_t notifications = 200000;
+
+    std::list<std::shared_ptr<Observer>> list;
+    ConcurrentSubject subject;
+
+    for (size_t i = 0; i < observerCount; ++i) {
+        std::shared_ptr<Observer> observer = std::make_shared<CountingObserver>();
+        list.push_back(observer);
+        subject.attach(observer);
+    }
+
+    //observer.cpp 的通知方式：按值复制每个 shared_ptr
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < notifications; ++i) {
+        for (auto observer : list) {
+            observer->update();
+        }
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < notifications; ++i) {
+        subject.notifyAllObservers();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << observerCount << " observers, " << notifications << " notifications" << std::endl;
+    std::cout << "std::list<std::shared_ptr<Observer>>: " << std::chrono::duration<double, std::milli>
+              (middle - start).count() << " ms" << std::endl;
+    std::cout << "snapshot: " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" <<
+              std::endl;
+
+    //通知的同时在另一个线程中不断 attach/detach
+    //每 64 次 synchronize 一次，之后旧快照不应再持有被 detach 的观察者
+    std::atomic<bool> stop(false);
+    bool released = true;
+    std::thread writer([&subject, &stop, &released]() {
+        for (size_t i = 1; !stop.load(); ++i) {
+            std::shared_ptr<Observer> observer = std::make_shared<CountingObserver>();
+            subject.attach(observer);
+            subject.detach(observer);
+
+            if (i % 64 == 0) {
+                subject.synchronize();
+                released = released && observer.use_count() == 1;
+            }
+        }
+    });
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < notifications; ++i) {
+        subject.notifyAllObservers();
+    }
+
+    end = std::chrono::steady_clock::now();
+    stop.store(true);
+    writer.join();
+
+    std::cout << "snapshot with concurrent attach/detach: " << std::chrono::duration<double, std::milli>
+              (end - start).count() << " ms" << std::endl;
+
+    if (!released) {
+        std::cout << "detached observer still referenced after synchronize" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench();
+    }
+
+    ConcurrentSubject subject;
+
+    std::shared_ptr<BinaryObserver> binaryObserver = std::make_shared<BinaryObserver>(subject);
+    std::shared_ptr<OctalObserver> octalObserver = std::make_shared<OctalObserver>(subject);
+    std::shared_ptr<HexaObserver> hexaObserver = std::make_shared<HexaObserver>(subject);
+
+    subject.attach(binaryObserver);
+    subject.attach(octalObserver);
+    subject.attach(hexaObserver);
+
+    std::cout << "First state change: 15" << std::endl;
+    subject.setState(15);
+
+    //在另一个线程中 detach
+    std::thread([&subject, octalObserver]() {
+        subject.detach(octalObserver);
+        subject.synchronize();
+    }).join();
+
+    std::cout << "Second state change: 10" << std::endl;
+    subject.setState(10);
+
+    return 0;
+}
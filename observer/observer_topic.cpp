@@ -0,0 +1,399 @@
+/**
+ * 观察者模式（Observer Pattern）的按主题分片通知
+ *
+ * observer.cpp 中的 Subject 每次状态变化都要遍历全部观察者。当一个数据源有上百万个订阅者、
+ * 每个订阅者只关心其中几个键（主题）时，绝大部分 update() 调用都是无用的。
+ *
+ * 这里的 TopicSubject 按主题建立索引：
+ *      1、观察者按自身地址的哈希固定分到一个分片，每个分片有自己的 主题 -> 观察者列表 索引。
+ *      2、每个分片由线程池中固定的一个线程负责投递，状态变化时所有分片并行查找自己的索引，
+ *         只通知订阅了该主题的观察者。热点主题的订阅者分散在各个分片中，也能并行投递。
+ *      3、一次通知的代价是 分片数 次哈希查找加上感兴趣的订阅者个数，与订阅者总数无关。
+ * 同一个观察者总是由同一个分片通知，update 不需要加锁；不同观察者的 update 会并发执行。
+ * 多个线程同时 publish 时逐批投递。投递时不持有分片的锁，遍历的是订阅者列表的快照，
+ * 这期间 subscribe/unsubscribe 先复制列表再修改，所以 update 中可以订阅和退订，但不能再次 publish。
+ *
+ * 运行 `observer_topic bench [observers]` 对比遍历全部观察者与按主题投递的耗时。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class TopicObserver {
+public:
+    virtual ~TopicObserver() = default;
+    virtual void update(const std::string& topic, int state) = 0;
+};
+
+//固定数量的线程，run(task) 让每个线程各执行一次 task(shard)，调用线程执行 shard 0；多个线程同时 run 时依次执行
+class ShardPool {
+public:
+    ShardPool(size_t threads) : m_threads(std::max<size_t>(threads, 1)), m_generation(0), m_pending(0),
+        m_stop(false) {
+        for (size_t shard = 1; shard < m_threads; ++shard) {
+            m_workers.push_back(std::thread(&ShardPool::work, this, shard));
+        }
+    }
+
+    ~ShardPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_start.notify_all();
+
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    size_t size() const {
+        return m_threads;
+    }
+
+    void run(const std::function<void(size_t)>& task) {
+        //m_task 指向调用者栈上的 task，同一时刻只能有一个 run
+        std::lock_guard<std::mutex> running(m_runMutex);
+
+        if (m_threads == 1) {
+            task(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_pending = m_threads - 1;
+            ++m_generation;
+        }
+
+        m_start.notify_all();
+        task(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() {
+            return m_pending == 0;
+        });
+    }
+
+private:
+    void work(size_t shard) {
+        uint64_t seen = 0;
+
+        while (true) {
+            const std::function<void(size_t)>* task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [this, seen]() {
+                    return m_stop || m_generation != seen;
+                });
+
+                if (m_stop) {
+                    return;
+                }
+
+                seen = m_generation;
+                task = m_task;
+            }
+
+            (*task)(shard);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    size_t m_threads;
+    std::mutex m_runMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void(size_t)>* m_task;
+    uint64_t m_generation;
+    size_t m_pending;
+    bool m_stop;
+    std::vector<std::thread> m_workers;
+};
+
+class TopicSubject {
+public:
+    struct Change {
+        std::string topic;
+        int state;
+    };
+
+    //shards 为 0 时每个核心一个分片
+    TopicSubject(size_t shards = 0) : m_pool(shards != 0 ? shards : std::max<unsigned>
+                                                 (std::thread::hardware_concurrency(), 1)), m_shards(m_pool.size()) {}
+
+    void subscribe(const std::string& topic, std::shared_ptr<TopicObserver> observer) {
+        Shard& shard = shardOf(observer.get());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ObserverList& observers = shard.index[topic];
+
+        if (observers == nullptr) {
+            observers = std::make_shared<std::vector<std::shared_ptr<TopicObserver>>>();
+        } else if (shard.readers > 0) {
+            observers = std::make_shared<std::vector<std::shared_ptr<TopicObserver>>>(*observers);
+        }
+
+        observers->push_back(observer);
+    }
+
+    void unsubscribe(const std::string& topic, std::shared_ptr<TopicObserver> observer) {
+        Shard& shard = shardOf(observer.get());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(topic);
+
+        if (it == shard.index.end()) {
+            return;
+        }
+
+        if (shard.readers > 0) {
+            it->second = std::make_shared<std::vector<std::shared_ptr<TopicObserver>>>(*it->second);
+        }
+
+        std::vector<std::shared_ptr<TopicObserver>>& observers = *it->second;
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+
+        if (observers.empty()) {
+            shard.index.erase(it);
+        }
+    }
+
+    //返回通知的次数
+    size_t setState(const std::string& topic, int state) {
+        Change change = {topic, state};
+        return publish(std::vector<Change>(1, change));
+    }
+
+    //一批状态变化，各分片并行投递，返回通知的次数
+    size_t publish(const std::vector<Change>& changes) {
+        std::vector<size_t> delivered(m_shards.size(), 0);
+
+        m_pool.run([this, &changes, &delivered](size_t id) {
+            Shard& shard = m_shards[id];
+            //在锁内取出订阅者列表的快照，在锁外调用 update
+            std::vector<ObserverList> lists(changes.size());
+
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                ++shard.readers;
+
+                for (size_t i = 0; i < changes.size(); ++i) {
+                    auto it = shard.index.find(changes[i].topic);
+
+                    if (it != shard.index.end()) {
+                        lists[i] = it->second;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < changes.size(); ++i) {
+                if (lists[i] == nullptr) {
+                    continue;
+                }
+
+                for (auto& observer : *lists[i]) {
+                    observer->update(changes[i].topic, changes[i].state);
+                }
+
+                delivered[id] += lists[i]->size();
+            }
+
+            lists.clear();
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            --shard.readers;
+        });
+
+        size_t total = 0;
+
+        for (auto count : delivered) {
+            total += count;
+        }
+
+        return total;
+    }
+
+private:
+    typedef std::shared_ptr<std::vector<std::shared_ptr<TopicObserver>>> ObserverList;
+
+    //C++11 的 std::allocator 不保证超过 16 字节的对齐，alignas 在 std::vector 中不起作用，
+    //所以在相邻分片之间留出一个缓存行，两个分片的成员不会落在同一个缓存行上
+    struct Shard {
+        Shard() : readers(0) {}
+
+        std::mutex mutex;
+        std::unordered_map<std::string, ObserverList> index;
+        //正在锁外遍历快照的 publish 数，不为 0 时修改订阅者列表要先复制
+        size_t readers;
+        char padding[64];
+    };
+
+    Shard& shardOf(const TopicObserver* observer) {
+        uint64_t h = (uint64_t)(uintptr_t)observer * 0x9e3779b97f4a7c15ULL;
+        return m_shards[(h >> 32) % m_shards.size()];
+    }
+
+    ShardPool m_pool;
+    std::vector<Shard> m_shards;
+};
+
+class BinaryObserver: public TopicObserver {
+public:
+    virtual void update(const std::string& topic, int state) override {
+        std::cout << topic << " Binary String: " << std::bitset<32>(state) << std::endl;
+    }
+};
+
+class OctalObserver: public TopicObserver {
+public:
+    virtual void update(const std::string& topic, int state) override {
+        std::cout << topic << " Octal String: " << std::oct << state << std::dec << std::endl;
+    }
+};
+
+class HexaObserver: public TopicObserver {
+public:
+    virtual void update(const std::string& topic, int state) override {
+        std::cout << topic << " Hex String: " << std::hex << state << std::dec << std::endl;
+    }
+};
+
+//只关心一个主题；遍历全部观察者的对照实现里由观察者自己过滤
+class CountingObserver: public TopicObserver {
+public:
+    CountingObserver(const std::string* topic) : m_topic(topic), m_count(0) {}
+
+    virtual void update(const std::string& topic, int) override {
+        if (topic == *m_topic) {
+            ++m_count;
+        }
+    }
+
+    size_t getCount() const {
+        return m_count;
+    }
+
+private:
+    const std::string* m_topic;
+    size_t m_count;
+};
+
+static int bench(size_t observerCount) {
+    const size_t topicCount = 10000;
+    std::vector<std::string> topics;
+
+    for (size_t i = 0; i < topicCount; ++i) {
+        topics.push_back("key" + std::to_string(i));
+    }
+
+    //主题的热度不均匀：前 1% 的主题占一半订阅者
+    std::default_random_engine engine;
+    std::uniform_int_distribution<size_t> hot(0, topicCount / 100 - 1);
+    std::uniform_int_distribution<size_t> cold(0, topicCount - 1);
+    std::vector<std::shared_ptr<TopicObserver>> observers;
+    TopicSubject subject;
+
+    for (size_t i = 0; i < observerCount; ++i) {
+        const std::string& topic = topics[i % 2 ? hot(engine) : cold(engine)];
+        observers.push_back(std::make_shared<CountingObserver>(&topic));
+        subject.subscribe(topic, observers.back());
+    }
+
+    std::vector<TopicSubject::Change> changes;
+
+    for (int i = 0; i < 100; ++i) {
+        TopicSubject::Change change = {topics[cold(engine)], i};
+        changes.push_back(change);
+    }
+
+    //observer.cpp 的方式：每次变化通知所有观察者
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& change : changes) {
+        for (auto& observer : observers) {
+            observer->update(change.topic, change.state);
+        }
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+    size_t delivered = 0;
+
+    for (auto& change : changes) {
+        delivered += subject.setState(change.topic, change.state);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    //两种方式各通知一次，每个观察者的计数应该是它感兴趣的变化数的两倍
+    size_t counted = 0;
+
+    for (auto& observer : observers) {
+        counted += static_cast<CountingObserver&>(*observer).getCount();
+    }
+
+    std::cout << "observers: " << observerCount << ", topics: " << topicCount << ", shards: " <<
+              std::max<unsigned>(std::thread::hardware_concurrency(), 1) << ", changes: " << changes.size() << std::endl;
+    std::cout << "broadcast: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms" <<
+              std::endl;
+    std::cout << "topic: " << delivered << " notifications, " << std::chrono::duration<double, std::milli>
+              (end - middle).count() << " ms" << std::endl;
+
+    //热点主题
+    start = std::chrono::steady_clock::now();
+    TopicSubject::Change hotChange = {topics[0], 0};
+    size_t hotCount = subject.publish(std::vector<TopicSubject::Change>(100, hotChange));
+    end = std::chrono::steady_clock::now();
+    std::cout << "hot topic x100: " << hotCount << " notifications, " << std::chrono::duration<double, std::milli>
+              (end - start).count() << " ms" << std::endl;
+
+    return counted == delivered * 2 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoul(argv[2]) : 1000000);
+    }
+
+    //只有一个分片，输出不会交错
+    TopicSubject subject(1);
+
+    std::shared_ptr<BinaryObserver> binaryObserver = std::make_shared<BinaryObserver>();
+    std::shared_ptr<OctalObserver> octalObserver = std::make_shared<OctalObserver>();
+    std::shared_ptr<HexaObserver> hexaObserver = std::make_shared<HexaObserver>();
+
+    subject.subscribe("temperature", binaryObserver);
+    subject.subscribe("temperature", octalObserver);
+    subject.subscribe("pressure", hexaObserver);
+
+    std::cout << "temperature change: 15" << std::endl;
+    subject.setState("temperature", 15);
+
+    std::cout << "pressure change: 10" << std::endl;
+    subject.setState("pressure", 10);
+
+    std::cout << "humidity change: 7" << std::endl;
+    subject.setState("humidity", 7);
+
+    return 0;
+}
@@ -0,0 +1,364 @@
+/**
+ * 观察者模式（Observer Pattern）的弱引用订阅
+ *
+ * observer.cpp 中 Subject 持有观察者的 std::shared_ptr，BinaryObserver 等观察者又持有 Subject 的
+ * std::shared_ptr，形成循环引用，每一对 Subject/Observer 都无法释放。订阅频繁创建和销毁时内存会一直增长。
+ *
+ * 这里改为：
+ *      1、Subject 只保存观察者的 std::weak_ptr，观察者只保存 Subject 的 std::weak_ptr，双方互不拥有。
+ *      2、subscribe 返回一个 Subscription 句柄，句柄析构时自动退订（RAII），也可以调用 release()
+ *         放弃句柄，订阅一直保留到观察者被销毁为止。
+ *      3、订阅保存在槽位数组中，退订把槽位放回空闲链表，槽位带有版本号，重复退订或过期的句柄不会误删新订阅。
+ *         退订和订阅都不分配内存（数组扩容除外）。
+ *      4、已经销毁但没有退订的观察者在通知时被惰性清理。
+ *
+ * 运行 `observer_weak bench [cycles]` 做订阅/退订的长时间测试并定期输出常驻内存（RSS），
+ * 再用 observer.cpp 的写法做同样的循环作为对照。
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+class Observer {
+public:
+    virtual ~Observer() = default;
+    virtual void update() = 0;
+};
+
+class Subject;
+
+class Subscription {
+public:
+    Subscription() : m_index(0), m_generation(0) {}
+
+    Subscription(std::weak_ptr<Subject> subject, uint32_t index, uint32_t generation) : m_subject(subject),
+        m_index(index), m_generation(generation) {}
+
+    ~Subscription() {
+        unsubscribe();
+    }
+
+    Subscription(Subscription&& other) : m_subject(std::move(other.m_subject)), m_index(other.m_index),
+        m_generation(other.m_generation) {
+        other.m_subject.reset();
+    }
+
+    Subscription& operator=(Subscription&& other) {
+        if (this != &other) {
+            unsubscribe();
+            m_subject = std::move(other.m_subject);
+            m_index = other.m_index;
+            m_generation = other.m_generation;
+            other.m_subject.reset();
+        }
+
+        return *this;
+    }
+
+    Subscription(const Subscription&) = delete;
+    Subscription& operator=(const Subscription&) = delete;
+
+    //Subject 已经销毁时什么也不做
+    inline void unsubscribe();
+
+    //放弃句柄，订阅保留到观察者销毁后被惰性清理
+    void release() {
+        m_subject.reset();
+    }
+
+private:
+    std::weak_ptr<Subject> m_subject;
+    uint32_t m_index;
+    uint32_t m_generation;
+};
+
+class Subject: public std::enable_shared_from_this<Subject> {
+public:
+    Subject() : m_state(0), m_count(0) {}
+
+    int getState() const {
+        return m_state;
+    }
+
+    void setState(int state) {
+        m_state = state;
+        notifyAllObservers();
+    }
+
+    Subscription subscribe(std::shared_ptr<Observer> observer) {
+        uint32_t index;
+
+        if (m_free.empty()) {
+            index = (uint32_t)m_slots.size();
+            m_slots.push_back(Slot());
+        } else {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+
+        m_slots[index].observer = observer;
+        ++m_slots[index].generation;
+        ++m_count;
+        return Subscription(shared_from_this(), index, m_slots[index].generation);
+    }
+
+    void unsubscribe(uint32_t index, uint32_t generation) {
+        if (index < m_slots.size() && m_slots[index].generation == generation) {
+            freeSlot(index);
+        }
+    }
+
+    //update 中可以订阅或退订
+    void notifyAllObservers() {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].generation % 2 == 0) {
+                continue;
+            }
+
+            std::shared_ptr<Observer> observer = m_slots[i].observer.lock();
+
+            if (observer) {
+                observer->update();
+            } else {
+                freeSlot((uint32_t)i);
+            }
+        }
+    }
+
+    size_t getObserverCount() const {
+        return m_count;
+    }
+
+    size_t getSlotCount() const {
+        return m_slots.size();
+    }
+
+private:
+    //generation 为奇数表示槽位正在使用，每次分配和释放都加一
+    struct Slot {
+        Slot() : generation(0) {}
+
+        std::weak_ptr<Observer> observer;
+        uint32_t generation;
+    };
+
+    void freeSlot(uint32_t index) {
+        //weak_ptr 会让 make_shared 分配的整块内存一直保留，必须及时清掉
+        m_slots[index].observer.reset();
+        ++m_slots[index].generation;
+        m_free.push_back(index);
+        --m_count;
+    }
+
+    int m_state;
+    size_t m_count;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+};
+
+void Subscription::unsubscribe() {
+    std::shared_ptr<Subject> subject = m_subject.lock();
+
+    if (subject) {
+        subject->unsubscribe(m_index, m_generation);
+    }
+
+    m_subject.reset();
+}
+
+class BinaryObserver: public Observer {
+public:
+    BinaryObserver(std::weak_ptr<Subject> subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::shared_ptr<Subject> subject = m_subject.lock();
+
+        if (subject) {
+            std::cout << "Binary String: " << std::bitset<32>(subject->getState()) << std::endl;
+        }
+    }
+private:
+    std::weak_ptr<Subject> m_subject;
+};
+
+class OctalObserver: public Observer {
+public:
+    OctalObserver(std::weak_ptr<Subject> subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::shared_ptr<Subject> subject = m_subject.lock();
+
+        if (subject) {
+            std::cout << "Octal String: " << std::oct << subject->getState() << std::dec << std::endl;
+        }
+    }
+private:
+    std::weak_ptr<Subject> m_subject;
+};
+
+class HexaObserver: public Observer {
+public:
+    HexaObserver(std::weak_ptr<Subject> subject) : m_subject(subject) {}
+
+    virtual void update() override {
+        std::shared_ptr<Subject> subject = m_subject.lock();
+
+        if (subject) {
+            std::cout << "Hex String: " << std::hex << subject->getState() << std::dec << std::endl;
+        }
+    }
+private:
+    std::weak_ptr<Subject> m_subject;
+};
+
+//当前进程的常驻内存（KB）
+static size_t residentKB() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+
+    if (file != nullptr) {
+        if (std::fscanf(file, "%lu %lu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+
+        std::fclose(file);
+    }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+//observer.cpp 的写法，只用于对照
+class LegacySubject {
+public:
+    void attach(std::shared_ptr<Observer> observer) {
+        m_observers.push_back(observer);
+    }
+
+private:
+    std::list<std::shared_ptr<Observer>> m_observers;
+};
+
+class LegacyObserver: public Observer {
+public:
+    LegacyObserver(std::shared_ptr<LegacySubject> subject) : m_subject(subject) {}
+
+    virtual void update() override {}
+
+private:
+    std::shared_ptr<LegacySubject> m_subject;
+};
+
+class SilentObserver: public Observer {
+public:
+    SilentObserver(std::weak_ptr<Subject> subject) : m_subject(subject) {}
+
+    virtual void update() override {}
+
+private:
+    std::weak_ptr<Subject> m_subject;
+};
+
+static int bench(uint64_t cycles) {
+    const uint64_t report = std::max<uint64_t>(cycles / 10, 1);
+    std::shared_ptr<Subject> subject = std::make_shared<Subject>();
+    //一直存活的观察者，通知时需要遍历
+    std::vector<std::shared_ptr<Observer>> residentObservers;
+    std::vector<Subscription> resident;
+
+    for (int i = 0; i < 100; ++i) {
+        residentObservers.push_back(std::make_shared<SilentObserver>(subject));
+        resident.push_back(subject->subscribe(residentObservers.back()));
+    }
+
+    size_t firstKB = 0;
+    size_t maxKB = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    std::cout << "cycles\tRSS KB\tobservers\tslots" << std::endl;
+
+    for (uint64_t cycle = 1; cycle <= cycles; ++cycle) {
+        std::shared_ptr<Observer> observer = std::make_shared<SilentObserver>(subject);
+        Subscription subscription = subject->subscribe(observer);
+
+        if (cycle % 8 == 0) {
+            //不退订，观察者销毁后由通知惰性清理
+            subscription.release();
+        }
+
+        if (cycle % 1024 == 0) {
+            subject->setState((int)cycle);
+
+            //短命的 Subject/Observer 对，没有循环引用
+            std::shared_ptr<Subject> temporary = std::make_shared<Subject>();
+            Subscription pair = temporary->subscribe(std::make_shared<SilentObserver>(temporary));
+        }
+
+        if (cycle % report == 0) {
+            size_t kb = residentKB();
+            firstKB = firstKB == 0 ? kb : firstKB;
+            maxKB = std::max(maxKB, kb);
+            std::cout << cycle << "\t" << kb << "\t" << subject->getObserverCount() << "\t" <<
+                      subject->getSlotCount() << std::endl;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "weak: " << cycles << " cycles, " << seconds << " s, " << seconds * 1e9 / cycles <<
+              " ns per cycle" << std::endl;
+
+    //对照：observer.cpp 的循环引用，每一对都泄漏
+    const uint64_t legacyCycles = std::min<uint64_t>(cycles, 1000000);
+    size_t legacyStartKB = residentKB();
+
+    for (uint64_t cycle = 0; cycle < legacyCycles; ++cycle) {
+        std::shared_ptr<LegacySubject> legacy = std::make_shared<LegacySubject>();
+        legacy->attach(std::make_shared<LegacyObserver>(legacy));
+    }
+
+    std::cout << "legacy: " << legacyCycles << " cycles, RSS +" << residentKB() - legacyStartKB << " KB" <<
+              std::endl;
+
+    //允许分配器有少量波动
+    return maxKB <= firstKB + 1024 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        return bench(argc > 2 ? std::stoull(argv[2]) : 100000000);
+    }
+
+    std::shared_ptr<Subject> subject = std::make_shared<Subject>();
+
+    std::shared_ptr<BinaryObserver> binaryObserver = std::make_shared<BinaryObserver>(subject);
+    std::shared_ptr<OctalObserver> octalObserver = std::make_shared<OctalObserver>(subject);
+    std::shared_ptr<HexaObserver> hexaObserver = std::make_shared<HexaObserver>(subject);
+
+    Subscription binarySubscription = subject->subscribe(binaryObserver);
+    Subscription octalSubscription = subject->subscribe(octalObserver);
+    subject->subscribe(hexaObserver).release();
+
+    std::cout << "First state change: 15" << std::endl;
+    subject->setState(15);
+
+    //退订 OctalObserver，销毁 HexaObserver
+    octalSubscription.unsubscribe();
+    hexaObserver.reset();
+
+    std::cout << "Second state change: 10" << std::endl;
+    subject->setState(10);
+    std::cout << "Observers: " << subject->getObserverCount() << std::endl;
+
+    return 0;
+}